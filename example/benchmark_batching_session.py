@@ -0,0 +1,47 @@
+# Measure the throughput and latency of a BatchingSession against its max wait
+import ortpy as ort
+import numpy as np
+from pathlib import Path
+from concurrent.futures import ThreadPoolExecutor
+import argparse
+import time
+
+parser = argparse.ArgumentParser(description="Benchmark dynamic batching of batch size 1 requests.")
+parser.add_argument("--model_path", "-m", type=Path, required=True,
+                    help="Path to an ONNX model with a dynamic batch dimension on axis 0.")
+parser.add_argument("--num_clients", "-c", type=int, default=32, help="Number of concurrent python clients.")
+parser.add_argument("--num_inferences", "-n", type=int, default=200, help="Number of requests per client.")
+parser.add_argument("--max_batch_size", "-b", type=int, default=32, help="Maximum batch size.")
+parser.add_argument("--max_wait_ms", type=float, nargs="+", default=[0.0, 0.5, 1.0, 2.0, 5.0],
+                    help="Max wait values to sweep.")
+args = parser.parse_args()
+
+session = ort.Session(str(args.model_path), ort.SessionOptions())
+inputs = {}
+for input_name, tensor_info in session.get_input_info().items():
+    # Use batch size 1 for the batch axis and any other symbolic dimension
+    shape = tuple(dim if dim > 0 else 1 for dim in tensor_info.shape)
+    inputs[input_name] = np.random.uniform(low=0, high=1, size=shape).astype(tensor_info.dtype)
+
+def client(run) -> list[float]:
+    latencies = []
+    for _ in range(args.num_inferences):
+        start = time.perf_counter()
+        run(inputs)
+        latencies.append(time.perf_counter() - start)
+    return latencies
+
+def bench(name: str, run) -> None:
+    with ThreadPoolExecutor(max_workers=args.num_clients) as executor:
+        start = time.perf_counter()
+        futures = [executor.submit(client, run) for _ in range(args.num_clients)]
+        latencies = np.concatenate([future.result() for future in futures])
+        elapsed = time.perf_counter() - start
+    throughput = len(latencies) / elapsed
+    p50, p99 = np.percentile(latencies, [50, 99]) * 1000
+    print(f"{name:>24}: {throughput:9.1f} req/s, p50 {p50:7.3f} ms, p99 {p99:7.3f} ms")
+
+bench("Session.run", session.run)
+for max_wait_ms in args.max_wait_ms:
+    batching = ort.BatchingSession(session, max_batch_size=args.max_batch_size, max_wait_ms=max_wait_ms)
+    bench(f"max_wait_ms={max_wait_ms}", batching.run)
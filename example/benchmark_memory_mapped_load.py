@@ -0,0 +1,54 @@
+# Compare the cold start time and memory of many processes loading one model, with and without memory mapping
+import ortpy as ort
+from pathlib import Path
+from concurrent.futures import ProcessPoolExecutor
+import multiprocessing
+import argparse
+import time
+
+parser = argparse.ArgumentParser(description="Benchmark loading a model in many processes.")
+parser.add_argument("--model_path", "-m", type=Path, required=True,
+                    help="Path to the model file. Use an ORT format model to share the weights between processes.")
+parser.add_argument("--num_processes", "-p", type=int, default=16, help="Number of worker processes.")
+args = parser.parse_args()
+
+def read_rss_kb() -> dict[str, int]:
+    # Linux only. RssFile counts the shared page cache, RssAnon the private copies.
+    rss = {}
+    status = Path("/proc/self/status")
+    if status.exists():
+        for line in status.read_text().splitlines():
+            key, _, value = line.partition(":")
+            if key in ("VmRSS", "RssAnon", "RssFile"):
+                rss[key] = int(value.split()[0])
+    return rss
+
+def load(model_path: str, memory_map: bool, barrier) -> tuple[float, dict[str, int]]:
+    barrier.wait()
+    start = time.perf_counter()
+    session = ort.Session(model_path, ort.SessionOptions(), memory_map=memory_map)
+    elapsed = time.perf_counter() - start
+    rss = read_rss_kb()
+    # Keep the session alive until every process has measured its memory
+    barrier.wait()
+    del session
+    return elapsed, rss
+
+def bench(memory_map: bool) -> None:
+    with multiprocessing.Manager() as manager:
+        barrier = manager.Barrier(args.num_processes)
+        with ProcessPoolExecutor(max_workers=args.num_processes) as executor:
+            futures = [executor.submit(load, str(args.model_path), memory_map, barrier)
+                       for _ in range(args.num_processes)]
+            results = [future.result() for future in futures]
+    times = sorted(elapsed for elapsed, _ in results)
+    print(f"memory_map={memory_map}: cold start median {times[len(times) // 2] * 1000:.1f} ms, "
+          f"max {times[-1] * 1000:.1f} ms")
+    for key in ("VmRSS", "RssAnon", "RssFile"):
+        values = [rss[key] for _, rss in results if key in rss]
+        if values:
+            print(f"    {key:>7}: {sum(values) / len(values) / 1024:.1f} MiB per process")
+
+if __name__ == "__main__":
+    bench(False)
+    bench(True)
@@ -0,0 +1,48 @@
+# Compare session options with the native benchmark harness
+import ortpy as ort
+from pathlib import Path
+from concurrent.futures import ProcessPoolExecutor
+import argparse
+
+parser = argparse.ArgumentParser(description="Benchmark a model with generated inputs, timed in native code.")
+parser.add_argument("--model_path", "-m", type=Path, required=True, help="Path to the ONNX model file.")
+parser.add_argument("--threads", "-t", type=int, nargs="+", default=[1, 2, 4], help="Client thread counts.")
+parser.add_argument("--batch_sizes", "-b", type=int, nargs="+", default=[1], help="Sizes of a dynamic first dim.")
+parser.add_argument("--dim", action="append", default=[], metavar="NAME=VALUE",
+                    help="Value of a named symbolic dimension. May be repeated.")
+parser.add_argument("--warmup_runs", type=int, default=10, help="Untimed runs per thread.")
+parser.add_argument("--timed_runs", "-n", type=int, default=100, help="Timed runs per thread.")
+args = parser.parse_args()
+
+dimension_overrides = {}
+for dim in args.dim:
+    name, _, value = dim.partition("=")
+    dimension_overrides[name] = int(value)
+
+def make_options(intra_op_num_threads: int) -> ort.SessionOptions:
+    session_options = ort.SessionOptions()
+    session_options.set_intra_op_num_threads(intra_op_num_threads)
+    return session_options
+
+configurations = {
+    "intra_op=1": 1,
+    "intra_op=default": 0,
+}
+
+def bench(intra_op_num_threads: int) -> list[tuple]:
+    # Runs in a fresh process, so the memory of one configuration does not show up in the next
+    session = ort.Session(str(args.model_path), make_options(intra_op_num_threads))
+    results = ort.benchmark(session, dimension_overrides, args.threads, args.batch_sizes,
+                            args.warmup_runs, args.timed_runs)
+    return [(result.num_threads, result.batch_size, result.p50_ms, result.p90_ms, result.p99_ms,
+             result.runs_per_second, result.samples_per_second, result.rss_increase_bytes) for result in results]
+
+if __name__ == "__main__":
+    print(f"{'configuration':>18} {'threads':>7} {'batch':>5} {'p50 ms':>8} {'p90 ms':>8} {'p99 ms':>8} "
+          f"{'runs/s':>9} {'samples/s':>10} {'+RSS MiB':>9}")
+    for name, intra_op_num_threads in configurations.items():
+        with ProcessPoolExecutor(max_workers=1) as executor:
+            results = executor.submit(bench, intra_op_num_threads).result()
+        for threads, batch, p50, p90, p99, runs, samples, rss_increase in results:
+            print(f"{name:>18} {threads:>7} {batch:>5} {p50:>8.3f} {p90:>8.3f} {p99:>8.3f} {runs:>9.1f} "
+                  f"{samples:>10.1f} {rss_increase / 1024 / 1024:>9.1f}")
@@ -0,0 +1,38 @@
+# Compare the per call overhead of Session.run and a PreparedRun on a tiny model
+import ortpy as ort
+import numpy as np
+from pathlib import Path
+import argparse
+import time
+
+parser = argparse.ArgumentParser(description="Microbenchmark Session.run against Session.prepare.")
+parser.add_argument("--model_path", "-m", type=Path, required=True, help="Path to a tiny ONNX model file.")
+parser.add_argument("--num_inferences", "-n", type=int, default=100000, help="Number of inferences per variant.")
+args = parser.parse_args()
+
+session_options = ort.SessionOptions()
+session_options.set_intra_op_num_threads(1)
+session = ort.Session(str(args.model_path), session_options)
+
+inputs = {}
+for input_name, tensor_info in session.get_input_info().items():
+    if any(dim <= 0 for dim in tensor_info.shape):
+        print("Model has non-positive input shapes. It is not run.")
+        exit(0)
+    inputs[input_name] = np.random.uniform(low=0, high=1, size=tuple(tensor_info.shape)).astype(tensor_info.dtype)
+
+input_names = session.get_input_names()
+prepared = session.prepare(input_names)
+arrays = [inputs[name] for name in input_names]
+
+def bench(name: str, fn) -> None:
+    for _ in range(100):
+        fn()
+    start = time.perf_counter()
+    for _ in range(args.num_inferences):
+        fn()
+    elapsed = time.perf_counter() - start
+    print(f"{name}: {elapsed / args.num_inferences * 1e6:.2f} us/call")
+
+bench("Session.run", lambda: session.run(inputs))
+bench("PreparedRun", lambda: prepared(*arrays))
@@ -0,0 +1,37 @@
+# Compare the startup time of a session without a cache, with a cold cache and with a warm cache
+import ortpy as ort
+from pathlib import Path
+from concurrent.futures import ProcessPoolExecutor
+import argparse
+import tempfile
+import time
+
+parser = argparse.ArgumentParser(description="Benchmark session creation with the optimized model cache.")
+parser.add_argument("--model_path", "-m", type=Path, required=True, help="Path to the ONNX model file.")
+parser.add_argument("--num_runs", "-n", type=int, default=5, help="Number of warm cache starts.")
+parser.add_argument("--memory_map", action="store_true", help="Memory map the cached model.")
+args = parser.parse_args()
+
+def start(model_path: str, cache_directory: str | None, memory_map: bool) -> float:
+    # Runs in a fresh process, so nothing is cached by ort in memory
+    session_options = ort.SessionOptions()
+    if cache_directory is not None:
+        session_options.set_optimized_model_cache_directory(cache_directory)
+    begin = time.perf_counter()
+    ort.Session(model_path, session_options, memory_map=memory_map)
+    return time.perf_counter() - begin
+
+def start_in_new_process(cache_directory: str | None, memory_map: bool = False) -> float:
+    with ProcessPoolExecutor(max_workers=1) as executor:
+        return executor.submit(start, str(args.model_path), cache_directory, memory_map).result()
+
+if __name__ == "__main__":
+    with tempfile.TemporaryDirectory() as cache_directory:
+        no_cache = start_in_new_process(None)
+        cold = start_in_new_process(cache_directory)
+        warm = sorted(start_in_new_process(cache_directory, args.memory_map) for _ in range(args.num_runs))
+        print(f"  no cache: {no_cache * 1000:9.1f} ms")
+        print(f"cold cache: {cold * 1000:9.1f} ms")
+        print(f"warm cache: {warm[len(warm) // 2] * 1000:9.1f} ms (median of {args.num_runs})")
+        for path in Path(cache_directory).iterdir():
+            print(f"Cached {path.name}: {path.stat().st_size / 1024 / 1024:.1f} MiB")
@@ -0,0 +1,68 @@
+# Compare the throughput and memory of a session pool with the same number of separate sessions
+import ortpy as ort
+import numpy as np
+from pathlib import Path
+from concurrent.futures import ProcessPoolExecutor, ThreadPoolExecutor
+import argparse
+import time
+
+parser = argparse.ArgumentParser(description="Benchmark a session pool as it grows, against separate sessions.")
+parser.add_argument("--model_path", "-m", type=Path, required=True, help="Path to the ONNX model file.")
+parser.add_argument("--sizes", "-s", type=int, nargs="+", default=[1, 2, 4, 8], help="Pool sizes.")
+parser.add_argument("--num_runs", "-n", type=int, default=200, help="Runs per thread.")
+args = parser.parse_args()
+
+def read_rss_mib() -> float:
+    # Linux only. Zero elsewhere.
+    status = Path("/proc/self/status")
+    if status.exists():
+        for line in status.read_text().splitlines():
+            key, _, value = line.partition(":")
+            if key == "VmRSS":
+                return int(value.split()[0]) / 1024
+    return 0.0
+
+def make_inputs(input_info: dict) -> dict:
+    inputs = {}
+    for input_name, tensor_info in input_info.items():
+        shape = tuple(dim if dim > 0 else 1 for dim in tensor_info.shape)
+        inputs[input_name] = np.random.uniform(low=0, high=1, size=shape).astype(tensor_info.dtype)
+    return inputs
+
+def bench(model_path: str, size: int, pooled: bool, num_runs: int) -> tuple[float, float]:
+    # Runs in a fresh process, so the memory of one configuration does not show up in the next
+    session_options = ort.SessionOptions()
+    # One thread per session, so the parallelism comes from the pool
+    session_options.set_intra_op_num_threads(1)
+    if pooled:
+        pool = ort.SessionPool(model_path, session_options, size)
+        inputs = make_inputs(pool.get_input_info())
+
+        def worker(_: int) -> None:
+            for _ in range(num_runs):
+                with pool.checkout() as session:
+                    session.run(inputs)
+    else:
+        sessions = [ort.Session(model_path, session_options) for _ in range(size)]
+        inputs = make_inputs(sessions[0].get_input_info())
+
+        def worker(index: int) -> None:
+            for _ in range(num_runs):
+                sessions[index].run(inputs)
+
+    rss = read_rss_mib()
+    with ThreadPoolExecutor(max_workers=size) as executor:
+        start = time.perf_counter()
+        list(executor.map(worker, range(size)))
+        elapsed = time.perf_counter() - start
+    return size * num_runs / elapsed, rss
+
+if __name__ == "__main__":
+    print(f"{'sessions':>8} {'pool runs/s':>12} {'pool MiB':>9} {'separate runs/s':>16} {'separate MiB':>13}")
+    for size in args.sizes:
+        results = []
+        for pooled in (True, False):
+            with ProcessPoolExecutor(max_workers=1) as executor:
+                results.append(executor.submit(bench, str(args.model_path), size, pooled, args.num_runs).result())
+        (pool_rate, pool_rss), (separate_rate, separate_rss) = results
+        print(f"{size:>8} {pool_rate:>12.1f} {pool_rss:>9.1f} {separate_rate:>16.1f} {separate_rss:>13.1f}")
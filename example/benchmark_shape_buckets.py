@@ -0,0 +1,42 @@
+# Compare a session with dynamic shapes to a shape bucketed session on random sequence lengths
+import ortpy as ort
+import numpy as np
+from pathlib import Path
+import argparse
+import time
+
+parser = argparse.ArgumentParser(description="Benchmark shape bucketing of a symbolic dimension.")
+parser.add_argument("--model_path", "-m", type=Path, required=True, help="Path to the ONNX model file.")
+parser.add_argument("--dimension", "-d", type=str, default="sequence_length",
+                    help="Name of the symbolic dimension to bucket. Other symbolic dimensions are set to 1.")
+parser.add_argument("--max_size", type=int, default=512, help="Largest size of the bucketed dimension.")
+parser.add_argument("--max_sessions", type=int, default=8, help="Number of specialized sessions kept.")
+parser.add_argument("--num_inferences", "-n", type=int, default=200, help="Number of inferences.")
+args = parser.parse_args()
+
+session_options = ort.SessionOptions()
+session = ort.Session(str(args.model_path), session_options)
+bucketed = ort.ShapeBucketedSession(str(args.model_path), session_options, [args.dimension],
+                                    max_sessions=args.max_sessions)
+
+rng = np.random.default_rng(0)
+requests = []
+for size in rng.integers(1, args.max_size + 1, size=args.num_inferences):
+    inputs = {}
+    for input_name, tensor_info in session.get_input_info().items():
+        shape = []
+        for dim, name in zip(tensor_info.shape, tensor_info.dimensions):
+            shape.append(dim if dim > 0 else (int(size) if name == args.dimension else 1))
+        inputs[input_name] = np.random.uniform(low=0, high=1, size=tuple(shape)).astype(tensor_info.dtype)
+    requests.append(inputs)
+
+# Create every bucket up front, so only the steady state is timed
+for inputs in requests:
+    bucketed.run(inputs)
+print(f"{bucketed.num_sessions} specialized sessions")
+
+for name, run in (("dynamic", session.run), ("bucketed", bucketed.run)):
+    start = time.perf_counter()
+    for inputs in requests:
+        run(inputs)
+    print(f"{name:>9}: {(time.perf_counter() - start) / len(requests) * 1000:.3f} ms per inference")
@@ -0,0 +1,24 @@
+# Create sessions for several models serially and in parallel
+import ortpy as ort
+from pathlib import Path
+import argparse
+import time
+
+parser = argparse.ArgumentParser(description="Compare serial and parallel session creation.")
+parser.add_argument("--model_paths", "-m", type=Path, nargs="+", required=True, help="Paths to the ONNX model files.")
+args = parser.parse_args()
+
+model_paths = [str(path) for path in args.model_paths]
+session_options = ort.SessionOptions()
+
+start = time.perf_counter()
+sessions = [ort.Session(path, session_options) for path in model_paths]
+print(f"Serial: {time.perf_counter() - start:.3f}s")
+del sessions
+
+start = time.perf_counter()
+futures = ort.create_sessions_parallel(model_paths, session_options)
+sessions = [future.result() for future in futures]
+print(f"Parallel: {time.perf_counter() - start:.3f}s")
+for path, session in zip(model_paths, sessions):
+    print(f"{path}: inputs {session.get_input_names()}, outputs {session.get_output_names()}")
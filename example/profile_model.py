@@ -0,0 +1,37 @@
+# Profile a model and print the slowest op types and nodes
+import ortpy as ort
+import numpy as np
+from pathlib import Path
+import argparse
+
+parser = argparse.ArgumentParser(description="Profile a model and summarize the kernel times.")
+parser.add_argument("--model_path", "-m", type=Path, required=True, help="Path to the ONNX model file.")
+parser.add_argument("--num_inferences", "-n", type=int, default=100, help="Number of profiled inferences.")
+parser.add_argument("--top", "-k", type=int, default=10, help="Number of op types and nodes to print.")
+args = parser.parse_args()
+
+session_options = ort.SessionOptions()
+session_options.enable_profiling("ortpy_profile")
+session = ort.Session(str(args.model_path), session_options)
+inputs = {}
+for input_name, tensor_info in session.get_input_info().items():
+    if any(dim <= 0 for dim in tensor_info.shape):
+        print("Model has non-positive input shapes. It is not run.")
+        exit(0)
+    inputs[input_name] = np.random.uniform(low=0, high=1, size=tuple(tensor_info.shape)).astype(tensor_info.dtype)
+
+for _ in range(args.num_inferences):
+    session.run(inputs)
+
+profile_path = session.end_profiling()
+summary = ort.parse_profile(profile_path)
+print(f"{profile_path}: {summary.num_runs} runs, {summary.run_total_us / max(summary.num_runs, 1):.1f} us/run")
+print()
+print(f"{'op type':>24} {'calls':>8} {'total us':>10}")
+for op_type, count, total in list(zip(summary.op_types, summary.op_counts, summary.op_total_us))[:args.top]:
+    print(f"{op_type:>24} {count:>8} {total:>10}")
+print()
+print(f"{'node':>40} {'op type':>16} {'provider':>24} {'us/call':>9}")
+nodes = zip(summary.node_names, summary.node_op_types, summary.node_providers, summary.node_counts, summary.node_total_us)
+for name, op_type, provider, count, total in list(nodes)[:args.top]:
+    print(f"{name:>40} {op_type:>16} {provider:>24} {total / count:>9.1f}")
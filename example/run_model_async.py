@@ -0,0 +1,35 @@
+# Keep many inferences in flight from one asyncio event loop
+import ortpy as ort
+import numpy as np
+from pathlib import Path
+import argparse
+import asyncio
+import time
+
+parser = argparse.ArgumentParser(description="Run an ONNX model with random data from asyncio.")
+parser.add_argument("--model_path", "-m", type=Path, required=True, help="Path to the ONNX model file.")
+parser.add_argument("--num_inferences", "-n", type=int, default=100, help="Number of concurrent inferences.")
+args = parser.parse_args()
+
+session_options = ort.SessionOptions()
+# RunAsync executes on the intra op thread pool of the session.
+session_options.set_intra_op_num_threads(4)
+session = ort.Session(str(args.model_path), session_options)
+
+inputs = {}
+for input_name, tensor_info in session.get_input_info().items():
+    if any(dim <= 0 for dim in tensor_info.shape):
+        print("Model has non-positive input shapes. It is not run.")
+        exit(0)
+    inputs[input_name] = np.random.uniform(low=0, high=1, size=tuple(tensor_info.shape)).astype(tensor_info.dtype)
+
+async def main() -> None:
+    start = time.perf_counter()
+    results = await asyncio.gather(
+        *(asyncio.wrap_future(session.run_async(inputs)) for _ in range(args.num_inferences)))
+    elapsed = time.perf_counter() - start
+    print(f"{len(results)} inferences completed in {elapsed:.3f}s")
+    for output_name, output in results[0].items():
+        print(f"Output {output_name}: {output.shape} {output.dtype}")
+
+asyncio.run(main())
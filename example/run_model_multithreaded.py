@@ -0,0 +1,45 @@
+# Run a model with random inputs from multiple python threads sharing one session
+import ortpy as ort
+import numpy as np
+from pathlib import Path
+from concurrent.futures import ThreadPoolExecutor
+import argparse
+import time
+
+parser = argparse.ArgumentParser(description="Measure the throughput of one session shared by N python threads.")
+parser.add_argument("--model_path", "-m", type=Path, required=True, help="Path to the ONNX model file.")
+parser.add_argument("--num_inferences", "-n", type=int, default=200, help="Number of inferences per thread.")
+parser.add_argument("--max_threads", "-t", type=int, default=4, help="Maximum number of python threads.")
+parser.add_argument("--intra_op_num_threads", type=int, default=1, help="Intra op threads of the session.")
+args = parser.parse_args()
+
+session_options = ort.SessionOptions()
+session_options.set_intra_op_num_threads(args.intra_op_num_threads)
+session = ort.Session(str(args.model_path), session_options)
+
+inputs = {}
+for input_name, tensor_info in session.get_input_info().items():
+    if any(dim <= 0 for dim in tensor_info.shape):
+        print("Model has non-positive input shapes. It is not run.")
+        exit(0)
+    inputs[input_name] = np.random.uniform(low=0, high=1, size=tuple(tensor_info.shape)).astype(tensor_info.dtype)
+
+def worker(count: int) -> None:
+    for _ in range(count):
+        session.run(inputs)
+
+# Warm up
+worker(10)
+
+baseline = None
+for num_threads in range(1, args.max_threads + 1):
+    with ThreadPoolExecutor(max_workers=num_threads) as executor:
+        start = time.perf_counter()
+        futures = [executor.submit(worker, args.num_inferences) for _ in range(num_threads)]
+        for future in futures:
+            future.result()
+        elapsed = time.perf_counter() - start
+    throughput = num_threads * args.num_inferences / elapsed
+    if baseline is None:
+        baseline = throughput
+    print(f"{num_threads} thread(s): {throughput:.1f} inferences/s, {throughput / baseline:.2f}x")
@@ -0,0 +1,44 @@
+# Compare a session with symbolic dimensions to one specialized to fixed shapes
+import ortpy as ort
+import numpy as np
+from pathlib import Path
+import argparse
+import time
+
+parser = argparse.ArgumentParser(description="Run a model with its symbolic dimensions fixed.")
+parser.add_argument("--model_path", "-m", type=Path, required=True, help="Path to the ONNX model file.")
+parser.add_argument("--dim", action="append", default=[], metavar="NAME=VALUE",
+                    help="Value of a named symbolic dimension. May be repeated.")
+parser.add_argument("--num_inferences", "-n", type=int, default=100, help="Number of inferences.")
+args = parser.parse_args()
+
+dimensions = {}
+for dim in args.dim:
+    name, _, value = dim.partition("=")
+    dimensions[name] = int(value)
+
+session_options = ort.SessionOptions()
+sessions = {
+    "symbolic": ort.Session(str(args.model_path), session_options),
+    "specialized": ort.Session(str(args.model_path), session_options.with_free_dimension_overrides(dimensions)),
+}
+
+inputs = {}
+for input_name, tensor_info in sessions["symbolic"].get_input_info().items():
+    shape = []
+    for size, name in zip(tensor_info.shape, tensor_info.dimensions):
+        if size > 0:
+            shape.append(size)
+        elif name in dimensions:
+            shape.append(dimensions[name])
+        else:
+            print(f"Input {input_name} has an unnamed or unset symbolic dimension. Pass it with --dim.")
+            exit(0)
+    inputs[input_name] = np.random.uniform(low=0, high=1, size=tuple(shape)).astype(tensor_info.dtype)
+
+for name, session in sessions.items():
+    session.run(inputs)
+    start = time.perf_counter()
+    for _ in range(args.num_inferences):
+        session.run(inputs)
+    print(f"{name:>12}: {(time.perf_counter() - start) / args.num_inferences * 1000:.3f} ms per inference")
@@ -0,0 +1,30 @@
+# Split the time of session.run into input marshalling, ort compute and output wrapping
+import ortpy as ort
+import numpy as np
+from pathlib import Path
+import argparse
+
+parser = argparse.ArgumentParser(description="Run a model with the session metrics enabled.")
+parser.add_argument("--model_path", "-m", type=Path, required=True, help="Path to the ONNX model file.")
+parser.add_argument("--num_inferences", "-n", type=int, default=1000, help="Number of inferences.")
+args = parser.parse_args()
+
+session = ort.Session(str(args.model_path), ort.SessionOptions())
+inputs = {}
+for input_name, tensor_info in session.get_input_info().items():
+    if any(dim <= 0 for dim in tensor_info.shape):
+        print("Model has non-positive input shapes. It is not run.")
+        exit(0)
+    inputs[input_name] = np.random.uniform(low=0, high=1, size=tuple(tensor_info.shape)).astype(tensor_info.dtype)
+
+session.enable_metrics()
+for _ in range(args.num_inferences):
+    session.run(inputs)
+
+metrics = session.get_metrics()
+calls = metrics["calls"]
+for phase in ("input_ns", "run_ns", "output_ns"):
+    print(f"{phase:>10}: {metrics[phase] / calls / 1000:9.2f} us/call")
+print(f"  bytes in: {metrics['bytes_in'] / calls:.0f} per call, bytes out: {metrics['bytes_out'] / calls:.0f} per call")
+print()
+print(session.get_metrics_text(str(args.model_path.name)))
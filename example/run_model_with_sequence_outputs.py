@@ -0,0 +1,27 @@
+# Run a model with sequence, map or optional outputs, e.g. a classifier converted with a ZipMap
+import ortpy as ort
+import numpy as np
+from pathlib import Path
+import argparse
+
+parser = argparse.ArgumentParser(description="Run a model whose outputs are not all tensors.")
+parser.add_argument("--model_path", "-m", type=Path, required=True, help="Path to the ONNX model file.")
+parser.add_argument("--batch_size", "-b", type=int, default=2, help="Size of a dynamic first dim.")
+args = parser.parse_args()
+
+session = ort.Session(str(args.model_path), ort.SessionOptions())
+inputs = {}
+for input_name, tensor_info in session.get_input_info().items():
+    shape = [dim if dim > 0 else args.batch_size for dim in tensor_info.shape]
+    inputs[input_name] = np.random.uniform(low=0, high=1, size=tuple(shape)).astype(tensor_info.dtype)
+
+# Sequences are lists, maps are dicts and a missing optional output is None
+for name, output in session.run(inputs).items():
+    if isinstance(output, list):
+        print(f"{name}: sequence of {len(output)}")
+        for element in output:
+            print(f"    {element}")
+    elif output is None:
+        print(f"{name}: no value")
+    else:
+        print(f"{name}: {output}")
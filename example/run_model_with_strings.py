@@ -0,0 +1,37 @@
+# Run a model with string inputs, e.g. a tokenizer in the graph from onnxruntime-extensions
+import ortpy as ort
+import numpy as np
+from pathlib import Path
+import argparse
+
+parser = argparse.ArgumentParser(description="Run a model with string inputs and outputs.")
+parser.add_argument("--model_path", "-m", type=Path, required=True, help="Path to the ONNX model file.")
+parser.add_argument("--custom_ops_library", "-l", type=Path, default=None,
+                    help="Path to a custom ops library, e.g. the one of onnxruntime-extensions.")
+parser.add_argument("--text", "-t", type=str, nargs="+", default=["Hello world!", "ortpy runs strings"],
+                    help="The strings fed to each string input.")
+args = parser.parse_args()
+
+session_options = ort.SessionOptions()
+if args.custom_ops_library is not None:
+    session_options.register_custom_ops_library(str(args.custom_ops_library))
+session = ort.Session(str(args.model_path), session_options)
+
+# The bulk path: one buffer with the utf-8 bytes of every string and the offsets between them
+encoded = [text.encode("utf-8") for text in args.text]
+offsets = np.cumsum([0] + [len(text) for text in encoded], dtype=np.int64)
+from_buffer = ort.StringTensor.from_buffer(b"".join(encoded), offsets, [len(encoded)])
+from_array = ort.StringTensor.from_array(np.array(args.text))
+assert (from_buffer.to_numpy() == from_array.to_numpy()).all()
+
+inputs = {}
+for input_name, tensor_info in session.get_input_info().items():
+    if tensor_info.element_type != "string" or len(tensor_info.shape) != 1:
+        print(f"Input {input_name} is not a 1-D string tensor. The model is not run.")
+        exit(0)
+    inputs[input_name] = from_buffer
+
+for name, output in session.run(inputs).items():
+    if isinstance(output, ort.StringTensor):
+        output = output.to_numpy()
+    print(f"{name}: {output}")
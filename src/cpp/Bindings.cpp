@@ -6,6 +6,7 @@
 #include <nanobind/stl/unordered_map.h>
 #include <nanobind/stl/optional.h>
 #include <nanobind/stl/function.h>
+#include <nanobind/stl/variant.h>
 #include <memory>
 #include <optional>
 
@@ -53,6 +54,12 @@ NB_MODULE(_ortpy, m) {
         .value("MAX_EFFICIENCY", OrtExecutionProviderDevicePolicy_MAX_EFFICIENCY)
         .value("MIN_OVERALL_POWER", OrtExecutionProviderDevicePolicy_MIN_OVERALL_POWER);
 
+    nanobind::enum_<Ortpy::ArrayFramework>(m, "ArrayFramework")
+        .value("NUMPY", Ortpy::ArrayFramework::Numpy)
+        .value("PYTORCH", Ortpy::ArrayFramework::PyTorch)
+        .value("JAX", Ortpy::ArrayFramework::Jax)
+        .value("DLPACK", Ortpy::ArrayFramework::DLPack);
+
     nanobind::class_<Ortpy::HardwareDevice>(m, "HardwareDevice")
         .def_ro("type", &Ortpy::HardwareDevice::type)
         .def_ro("vendor_id", &Ortpy::HardwareDevice::vendorId)
@@ -67,6 +74,26 @@ NB_MODULE(_ortpy, m) {
         .def_ro("ep_options", &Ortpy::EpDevice::epOptions)
         .def_ro("device", &Ortpy::EpDevice::device);
 
+    nanobind::class_<Ortpy::ThreadingOptions>(m, "ThreadingOptions")
+        .def(nanobind::init<>())
+        .def("set_global_intra_op_num_threads",
+            &Ortpy::ThreadingOptions::SetGlobalIntraOpNumThreads,
+            nanobind::arg("intra_op_num_threads"))
+        .def("set_global_inter_op_num_threads",
+            &Ortpy::ThreadingOptions::SetGlobalInterOpNumThreads,
+            nanobind::arg("inter_op_num_threads"))
+        .def("set_global_spin_control",
+            &Ortpy::ThreadingOptions::SetGlobalSpinControl,
+            nanobind::arg("allow_spinning"))
+        .def("set_global_denormal_as_zero", &Ortpy::ThreadingOptions::SetGlobalDenormalAsZero)
+        .def("set_global_intra_op_thread_affinity",
+            &Ortpy::ThreadingOptions::SetGlobalIntraOpThreadAffinity,
+            nanobind::arg("affinity"));
+
+    m.def("init_global_thread_pools", [](const Ortpy::ThreadingOptions& options) -> void {
+        Ortpy::Env::InitializeWithGlobalThreadPools(options);
+    }, nanobind::arg("options"));
+
     m.def("register_execution_provider_library", [](const std::string& name, const std::string& path) -> void {
         Ortpy::Env::GetSingleton()->RegisterExecutionProviderLibrary(name, path);
     });
@@ -132,6 +159,27 @@ NB_MODULE(_ortpy, m) {
         .def("set_inter_op_num_threads",
             &Ortpy::SessionOptions::SetInterOpNumThreads,
             nanobind::arg("inter_op_num_threads"))
+        .def("disable_per_session_threads", &Ortpy::SessionOptions::DisablePerSessionThreads)
+        .def("add_session_config_entry",
+            &Ortpy::SessionOptions::AddSessionConfigEntry,
+            nanobind::arg("key"),
+            nanobind::arg("value"))
+        .def("add_free_dimension_override",
+            &Ortpy::SessionOptions::AddFreeDimensionOverride,
+            nanobind::arg("dimension_denotation"),
+            nanobind::arg("dimension_value"))
+        .def("add_free_dimension_override_by_name",
+            &Ortpy::SessionOptions::AddFreeDimensionOverrideByName,
+            nanobind::arg("dimension_name"),
+            nanobind::arg("dimension_value"))
+        .def("clone",
+            &Ortpy::SessionOptions::Clone,
+            /** A selection delegate is shared with the original. */
+            nanobind::keep_alive<0, 1>())
+        .def("with_free_dimension_overrides",
+            &Ortpy::SessionOptions::WithFreeDimensionOverrides,
+            nanobind::arg("dimensions"),
+            nanobind::keep_alive<0, 1>())
         .def("register_custom_ops_library",
             &Ortpy::SessionOptions::RegisterCustomOpsLibrary,
             nanobind::arg("library_path"))
@@ -145,6 +193,21 @@ NB_MODULE(_ortpy, m) {
         .def("set_ep_selection_policy_delegate",
             &Ortpy::SessionOptions::SetEpSelectionPolicyDelegate,
             nanobind::arg("delegate"))
+        .def("add_initializer",
+            &Ortpy::SessionOptions::AddInitializer,
+            nanobind::arg("name"),
+            nanobind::arg("array"))
+        .def("add_external_initializers",
+            &Ortpy::SessionOptions::AddExternalInitializers,
+            nanobind::arg("names"),
+            nanobind::arg("arrays"))
+        .def_prop_ro("repacked_bytes", &Ortpy::SessionOptions::GetRepackedBytes)
+        .def("set_compile_cache_directory",
+            &Ortpy::SessionOptions::SetCompileCacheDirectory,
+            nanobind::arg("directory"))
+        .def("set_optimized_model_cache_directory",
+            &Ortpy::SessionOptions::SetOptimizedModelCacheDirectory,
+            nanobind::arg("directory"))
         .def("create_model_compilation_options", &Ortpy::SessionOptions::CreateModelCompilationOptions);
 
     nanobind::class_<Ortpy::TensorInfo>(m, "TensorInfo")
@@ -152,9 +215,31 @@ NB_MODULE(_ortpy, m) {
         .def_ro("dimensions", &Ortpy::TensorInfo::dimensions)
         .def_prop_ro("dtype",
             [](const Ortpy::TensorInfo &self) -> std::string {
+                /** numpy's name for its fixed width unicode strings */
+                if (self.type == ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING)
+                {
+                    return "str";
+                }
                 return Ortpy::Value::NpTypeToName(self.dtype);
+            })
+        .def_prop_ro("element_type",
+            [](const Ortpy::TensorInfo &self) -> std::string {
+                return Ortpy::Value::OrtTypeToName(self.type);
             });
 
+    nanobind::class_<Ortpy::StringTensor>(m, "StringTensor")
+        .def_static("from_array",
+            &Ortpy::StringTensor::FromArray,
+            nanobind::arg("strings"))
+        .def_static("from_buffer",
+            &Ortpy::StringTensor::FromBuffer,
+            nanobind::arg("data"),
+            nanobind::arg("offsets"),
+            nanobind::arg("shape"))
+        .def_prop_ro("shape", &Ortpy::StringTensor::GetShape)
+        .def("get_content", &Ortpy::StringTensor::GetContent)
+        .def("to_numpy", &Ortpy::StringTensor::ToNumpy);
+
     nanobind::class_<Ortpy::RunOptions>(m, "RunOptions")
         .def(nanobind::init<>())
         .def_prop_rw("run_log_verbosity_level",
@@ -167,20 +252,228 @@ NB_MODULE(_ortpy, m) {
             &Ortpy::RunOptions::GetRunTag,
             &Ortpy::RunOptions::SetRunTag)
         .def("set_terminate", &Ortpy::RunOptions::SetTerminate)
-        .def("unset_terminate", &Ortpy::RunOptions::UnsetTerminate);
+        .def("unset_terminate", &Ortpy::RunOptions::UnsetTerminate)
+        .def("add_config_entry",
+            &Ortpy::RunOptions::AddConfigEntry,
+            nanobind::arg("key"),
+            nanobind::arg("value"));
 
     nanobind::class_<Ortpy::Session>(m, "Session")
-        .def(nanobind::init<const std::string&, const Ortpy::SessionOptions&>(),
+        .def(nanobind::init<const std::string&, const Ortpy::SessionOptions&, bool>(),
             nanobind::arg("model_path"),
-            nanobind::arg("options"))
-        .def(nanobind::init<const nanobind::bytes&, const Ortpy::SessionOptions&>(),
+            nanobind::arg("options"),
+            nanobind::arg("memory_map") = false,
+            /** Let other python threads run while the model loads. */
+            nanobind::call_guard<nanobind::gil_scoped_release>())
+        .def(nanobind::init<const nanobind::object&, const Ortpy::SessionOptions&>(),
             nanobind::arg("model_bytes"),
             nanobind::arg("options"))
+        .def_static("create_async",
+            &Ortpy::Session::CreateAsync,
+            nanobind::arg("model_path"),
+            nanobind::arg("options"),
+            nanobind::arg("memory_map") = false)
         .def("get_input_info", &Ortpy::Session::GetInputInfo)
         .def("get_output_info", &Ortpy::Session::GetOutputInfo)
+        .def("get_input_names", &Ortpy::Session::GetInputNames)
+        .def("get_output_names", &Ortpy::Session::GetOutputNames)
+        .def_prop_ro("repacked_bytes", &Ortpy::Session::GetRepackedBytes)
+        .def("enable_metrics",
+            &Ortpy::Session::EnableMetrics,
+            nanobind::arg("enabled") = true)
+        .def("reset_metrics", &Ortpy::Session::ResetMetrics)
+        .def("get_metrics", &Ortpy::Session::GetMetrics)
+        .def("get_metrics_text",
+            &Ortpy::Session::GetMetricsText,
+            nanobind::arg("session_name") = "")
+        .def("end_profiling",
+            &Ortpy::Session::EndProfiling,
+            /** ort writes the whole profile to disk. */
+            nanobind::call_guard<nanobind::gil_scoped_release>())
+        .def_prop_ro("profiling_start_time_ns", &Ortpy::Session::GetProfilingStartTimeNs)
         .def("run",
-            &Ortpy::Session::Run,
+            nanobind::overload_cast<const nanobind::dict&, const std::optional<std::vector<std::string>>&,
+                const std::optional<std::reference_wrapper<Ortpy::RunOptions>>&, Ortpy::ArrayFramework>(
+                &Ortpy::Session::Run, nanobind::const_),
+            nanobind::arg("inputs"),
+            nanobind::arg("output_names") = std::nullopt,
+            nanobind::arg("run_options") = std::nullopt,
+            nanobind::arg("output_framework") = Ortpy::ArrayFramework::Numpy)
+        .def("run_async",
+            &Ortpy::Session::RunAsync,
             nanobind::arg("inputs"),
             nanobind::arg("output_names") = std::nullopt,
-            nanobind::arg("run_options") = std::nullopt);
+            nanobind::arg("run_options") = std::nullopt,
+            nanobind::arg("output_framework") = Ortpy::ArrayFramework::Numpy)
+        .def("run_with_binding",
+            &Ortpy::Session::RunWithBinding,
+            nanobind::arg("binding"),
+            nanobind::arg("run_options") = std::nullopt)
+        .def("prepare",
+            &Ortpy::Session::Prepare,
+            nanobind::arg("input_names"),
+            nanobind::arg("output_names") = std::nullopt,
+            nanobind::arg("run_options") = std::nullopt,
+            nanobind::arg("output_framework") = Ortpy::ArrayFramework::Numpy,
+            /** The prepared run refers to the session and the run options. */
+            nanobind::keep_alive<0, 1>(),
+            nanobind::keep_alive<0, 4>());
+
+    m.def("create_sessions_parallel",
+        [](const std::vector<std::string>& modelPaths, const Ortpy::SessionOptions& options, bool memoryMap)
+            -> std::vector<nanobind::object> {
+            /** Each session is created on its own native thread. */
+            std::vector<nanobind::object> futures;
+            futures.reserve(modelPaths.size());
+            for (const auto& modelPath : modelPaths)
+            {
+                futures.push_back(Ortpy::Session::CreateAsync(modelPath, options, memoryMap));
+            }
+            return futures;
+        },
+        nanobind::arg("model_paths"),
+        nanobind::arg("options"),
+        nanobind::arg("memory_map") = false);
+
+    nanobind::class_<Ortpy::BenchmarkResult>(m, "BenchmarkResult")
+        .def_ro("num_threads", &Ortpy::BenchmarkResult::numThreads)
+        .def_ro("batch_size", &Ortpy::BenchmarkResult::batchSize)
+        .def_ro("num_runs", &Ortpy::BenchmarkResult::numRuns)
+        .def_ro("mean_ms", &Ortpy::BenchmarkResult::meanMs)
+        .def_ro("p50_ms", &Ortpy::BenchmarkResult::p50Ms)
+        .def_ro("p90_ms", &Ortpy::BenchmarkResult::p90Ms)
+        .def_ro("p99_ms", &Ortpy::BenchmarkResult::p99Ms)
+        .def_ro("runs_per_second", &Ortpy::BenchmarkResult::runsPerSecond)
+        .def_ro("samples_per_second", &Ortpy::BenchmarkResult::samplesPerSecond)
+        .def_ro("rss_increase_bytes", &Ortpy::BenchmarkResult::rssIncreaseBytes);
+
+    m.def("benchmark",
+        &Ortpy::Benchmark,
+        nanobind::arg("session"),
+        nanobind::arg("dimension_overrides") = std::unordered_map<std::string, int64_t>{},
+        nanobind::arg("thread_counts") = std::vector<size_t>{ 1 },
+        nanobind::arg("batch_sizes") = std::vector<int64_t>{ 1 },
+        nanobind::arg("warmup_runs") = 10,
+        nanobind::arg("timed_runs") = 100);
+
+    nanobind::class_<Ortpy::ProfileSummary>(m, "ProfileSummary")
+        .def_ro("num_runs", &Ortpy::ProfileSummary::numRuns)
+        .def_ro("run_total_us", &Ortpy::ProfileSummary::runTotalUs)
+        .def_ro("node_names", &Ortpy::ProfileSummary::nodeNames)
+        .def_ro("node_op_types", &Ortpy::ProfileSummary::nodeOpTypes)
+        .def_ro("node_providers", &Ortpy::ProfileSummary::nodeProviders)
+        .def_ro("node_total_us", &Ortpy::ProfileSummary::nodeTotalUs)
+        .def_ro("node_counts", &Ortpy::ProfileSummary::nodeCounts)
+        .def_ro("op_types", &Ortpy::ProfileSummary::opTypes)
+        .def_ro("op_total_us", &Ortpy::ProfileSummary::opTotalUs)
+        .def_ro("op_counts", &Ortpy::ProfileSummary::opCounts);
+
+    m.def("parse_profile",
+        &Ortpy::ProfileSummary::Parse,
+        nanobind::arg("profile_path"),
+        nanobind::call_guard<nanobind::gil_scoped_release>());
+
+    nanobind::class_<Ortpy::SessionPool>(m, "SessionPool")
+        .def(nanobind::init<const std::string&, const Ortpy::SessionOptions&, size_t, bool>(),
+            nanobind::arg("model_path"),
+            nanobind::arg("options"),
+            nanobind::arg("size"),
+            nanobind::arg("memory_map") = false,
+            nanobind::call_guard<nanobind::gil_scoped_release>())
+        .def(nanobind::init<const nanobind::object&, const Ortpy::SessionOptions&, size_t>(),
+            nanobind::arg("model_bytes"),
+            nanobind::arg("options"),
+            nanobind::arg("size"))
+        .def_prop_ro("size", &Ortpy::SessionPool::GetSize)
+        .def("get_input_info", &Ortpy::SessionPool::GetInputInfo)
+        .def("get_output_info", &Ortpy::SessionPool::GetOutputInfo)
+        .def("checkout",
+            &Ortpy::SessionPool::Checkout,
+            /** The lease hands out a session of the pool. */
+            nanobind::keep_alive<0, 1>())
+        .def("run",
+            &Ortpy::SessionPool::Run,
+            nanobind::arg("inputs"),
+            nanobind::arg("output_names") = std::nullopt,
+            nanobind::arg("run_options") = std::nullopt,
+            nanobind::arg("output_framework") = Ortpy::ArrayFramework::Numpy);
+
+    nanobind::class_<Ortpy::SessionPool::Lease>(m, "SessionLease")
+        .def_prop_ro("session", &Ortpy::SessionPool::Lease::GetSession, nanobind::rv_policy::reference_internal)
+        .def("release", &Ortpy::SessionPool::Lease::Release)
+        .def("__enter__", &Ortpy::SessionPool::Lease::GetSession, nanobind::rv_policy::reference_internal)
+        .def("__exit__", [](Ortpy::SessionPool::Lease& self, const nanobind::args&) -> void {
+            self.Release();
+        });
+
+    nanobind::class_<Ortpy::BatchingSession>(m, "BatchingSession")
+        .def(nanobind::init<const Ortpy::Session&, size_t, double, size_t>(),
+            nanobind::arg("session"),
+            nanobind::arg("max_batch_size") = 32,
+            nanobind::arg("max_wait_ms") = 1.0,
+            nanobind::arg("batch_axis") = 0,
+            /** The batching session runs the session from its own thread. */
+            nanobind::keep_alive<1, 2>())
+        .def("run",
+            &Ortpy::BatchingSession::Run,
+            nanobind::arg("inputs"),
+            nanobind::arg("output_framework") = Ortpy::ArrayFramework::Numpy);
+
+    nanobind::class_<Ortpy::ShapeBucketedSession>(m, "ShapeBucketedSession")
+        .def(nanobind::init<const std::string&, const Ortpy::SessionOptions&, const std::vector<std::string>&,
+                size_t, int64_t, bool>(),
+            nanobind::arg("model_path"),
+            nanobind::arg("options"),
+            nanobind::arg("dimension_names"),
+            nanobind::arg("max_sessions") = 4,
+            nanobind::arg("min_bucket_size") = 1,
+            nanobind::arg("memory_map") = false,
+            /** Sessions are specialized from the options on demand. */
+            nanobind::keep_alive<1, 3>(),
+            nanobind::call_guard<nanobind::gil_scoped_release>())
+        .def_static("get_bucket_size",
+            &Ortpy::ShapeBucketedSession::GetBucketSize,
+            nanobind::arg("size"),
+            nanobind::arg("min_bucket_size") = 1)
+        .def_prop_ro("num_sessions", &Ortpy::ShapeBucketedSession::GetNumSessions)
+        .def_prop_ro("padded_bytes", &Ortpy::ShapeBucketedSession::GetPaddedBytes)
+        .def("get_input_info", &Ortpy::ShapeBucketedSession::GetInputInfo)
+        .def("get_output_info", &Ortpy::ShapeBucketedSession::GetOutputInfo)
+        .def("run",
+            &Ortpy::ShapeBucketedSession::Run,
+            nanobind::arg("inputs"),
+            nanobind::arg("output_names") = std::nullopt,
+            nanobind::arg("run_options") = std::nullopt,
+            nanobind::arg("output_framework") = Ortpy::ArrayFramework::Numpy);
+
+    nanobind::class_<Ortpy::PreparedRun>(m, "PreparedRun")
+        .def("__call__", &Ortpy::PreparedRun::operator())
+        .def_prop_ro("input_names", &Ortpy::PreparedRun::GetInputNames)
+        .def_prop_ro("output_names", &Ortpy::PreparedRun::GetOutputNames);
+
+    nanobind::class_<Ortpy::IoBinding>(m, "IoBinding")
+        .def(nanobind::init<const Ortpy::Session&>(),
+            nanobind::arg("session"),
+            /** The binding refers to the session internally. */
+            nanobind::keep_alive<1, 2>())
+        .def("bind_input",
+            nanobind::overload_cast<const std::string&, const Ortpy::StringTensor&>(&Ortpy::IoBinding::BindInput),
+            nanobind::arg("name"),
+            nanobind::arg("strings"))
+        .def("bind_input",
+            nanobind::overload_cast<const std::string&, const Ortpy::InputArray&>(&Ortpy::IoBinding::BindInput),
+            nanobind::arg("name"),
+            nanobind::arg("array"))
+        .def("bind_output",
+            &Ortpy::IoBinding::BindOutput,
+            nanobind::arg("name"),
+            nanobind::arg("array"))
+        .def("bind_output_to_cpu",
+            &Ortpy::IoBinding::BindOutputToCpu,
+            nanobind::arg("name"))
+        .def("clear_bound_inputs", &Ortpy::IoBinding::ClearBoundInputs)
+        .def("clear_bound_outputs", &Ortpy::IoBinding::ClearBoundOutputs)
+        .def("get_outputs",
+            &Ortpy::IoBinding::GetOutputs,
+            nanobind::arg("output_framework") = Ortpy::ArrayFramework::Numpy);
 }
@@ -2,17 +2,43 @@
 #include <cstring>
 #include <string>
 #include <map>
+#include <algorithm>
+#include <bit>
+#include <future>
+#include <filesystem>
+#include <random>
+#include <latch>
+#include <cmath>
+#include <charconv>
+#include <fstream>
+#include <sstream>
 #include <nanobind/stl/function.h>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <psapi.h>
 #endif /** _WIN32 */
 
 #if defined(__linux__) || defined(__APPLE__)
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif /** __linux__ || __APPLE__ */
 
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#include <mach/mach.h>
+#endif /** __APPLE__ */
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif /** x86 */
+
 #ifdef _WIN32
 static std::wstring StringToWString(const std::string& str)
 {
@@ -33,6 +59,22 @@ static std::wstring StringToWString(const std::string& str)
 #define StringToOrtString(str) (str)
 #endif /** _WIN32 */
 
+/** Paths are UTF-8 in the bindings. A narrow path would use the code page on Windows. */
+static std::filesystem::path Utf8ToPath(const std::string& str)
+{
+#ifdef _WIN32
+    return std::filesystem::path(StringToWString(str));
+#else
+    return std::filesystem::path(str);
+#endif /** _WIN32 */
+}
+
+static std::string PathToUtf8(const std::filesystem::path& path)
+{
+    auto utf8 = path.u8string();
+    return std::string(utf8.begin(), utf8.end());
+}
+
 /** nanobind::dlpack::dtype modifications to be a map key */
 namespace nanobind::dlpack {
     inline bool operator<(const dtype& a, const dtype& b) {
@@ -44,31 +86,300 @@ namespace nanobind::dlpack {
 
 /** Global */
 
+/** The initializers are thread safe, as these may be first used off the GIL. A throw is retried on the next call. */
+
 const OrtApi* Ortpy::GetApi()
 {
-    static const OrtApi* api = nullptr;
-    if (api == nullptr)
-    {
-        api = OrtGetApiBase()->GetApi(ORT_API_VERSION);
+    static const OrtApi* api = []() {
+        const OrtApi* api = OrtGetApiBase()->GetApi(ORT_API_VERSION);
         if (api == nullptr)
         {
             throw std::runtime_error("Failed to get ONNX Runtime API");
         }
-    }
+        return api;
+    }();
     return api;
 }
 
 OrtAllocator* Ortpy::GetAllocator()
 {
-    static OrtAllocator* allocator = nullptr;
-    if (allocator == nullptr)
-    {
+    static OrtAllocator* allocator = []() {
+        OrtAllocator* allocator = nullptr;
         Ortpy::Status status = GetApi()->GetAllocatorWithDefaultOptions(&allocator);
         status.Check();
-    }
+        return allocator;
+    }();
     return allocator;
 }
 
+const OrtMemoryInfo* Ortpy::GetCpuMemoryInfo()
+{
+    static OrtMemoryInfo* memInfo = []() {
+        OrtMemoryInfo* memInfo = nullptr;
+        Ortpy::Status status = GetApi()->CreateCpuMemoryInfo(OrtArenaAllocator, OrtMemTypeDefault, &memInfo);
+        status.Check();
+        return memInfo;
+    }();
+    return memInfo;
+}
+
+static bool IsCContiguous(const Ortpy::InputArray& array)
+{
+    /** dlpack strides are in elements. Dimensions of size 1 can have any stride. */
+    int64_t expected = 1;
+    for (size_t i = array.ndim(); i-- > 0;)
+    {
+        if (array.shape(i) != 1 && array.stride(i) != expected)
+        {
+            return false;
+        }
+        expected *= array.shape(i);
+    }
+    return true;
+}
+
+template <typename T>
+static void CopyStridedRow(uint8_t* dst, int64_t dstStride, const uint8_t* src, int64_t srcStride, int64_t count)
+{
+    /** Fixed size copies, which the compiler turns into plain (and vectorizable) loads and stores. */
+    for (int64_t i = 0; i < count; i++)
+    {
+        std::memcpy(dst + i * dstStride, src + i * srcStride, sizeof(T));
+    }
+}
+
+static void CopyStridedDims(uint8_t* dst, const int64_t* dstStrides, const uint8_t* src, const int64_t* srcStrides,
+    const int64_t* shape, size_t ndim, size_t elementSize)
+{
+    if (ndim == 1)
+    {
+        int64_t count = shape[0];
+        if (dstStrides[0] == static_cast<int64_t>(elementSize) && srcStrides[0] == static_cast<int64_t>(elementSize))
+        {
+            std::memcpy(dst, src, static_cast<size_t>(count) * elementSize);
+            return;
+        }
+        switch (elementSize)
+        {
+            case 1: CopyStridedRow<uint8_t>(dst, dstStrides[0], src, srcStrides[0], count); return;
+            case 2: CopyStridedRow<uint16_t>(dst, dstStrides[0], src, srcStrides[0], count); return;
+            case 4: CopyStridedRow<uint32_t>(dst, dstStrides[0], src, srcStrides[0], count); return;
+            case 8: CopyStridedRow<uint64_t>(dst, dstStrides[0], src, srcStrides[0], count); return;
+        }
+        for (int64_t i = 0; i < count; i++)
+        {
+            std::memcpy(dst + i * dstStrides[0], src + i * srcStrides[0], elementSize);
+        }
+        return;
+    }
+    for (int64_t i = 0; i < shape[0]; i++)
+    {
+        CopyStridedDims(dst + i * dstStrides[0], dstStrides + 1, src + i * srcStrides[0], srcStrides + 1,
+            shape + 1, ndim - 1, elementSize);
+    }
+}
+
+/**
+ * Copies a strided block of elements. The strides are in bytes.
+ * Dimensions that are contiguous in both the source and the destination are merged first,
+ *     so that the innermost copies are as long as possible.
+ */
+static void CopyStrided(void* dst, const int64_t* dstStrides, const void* src, const int64_t* srcStrides,
+    const int64_t* shape, size_t ndim, size_t elementSize)
+{
+    std::vector<int64_t> mergedShape;
+    std::vector<int64_t> mergedDst;
+    std::vector<int64_t> mergedSrc;
+    mergedShape.reserve(ndim);
+    mergedDst.reserve(ndim);
+    mergedSrc.reserve(ndim);
+    for (size_t i = 0; i < ndim; i++)
+    {
+        if (shape[i] == 0)
+        {
+            return;
+        }
+        if (shape[i] == 1)
+        {
+            continue;
+        }
+        if (!mergedShape.empty() &&
+            mergedDst.back() == dstStrides[i] * shape[i] &&
+            mergedSrc.back() == srcStrides[i] * shape[i])
+        {
+            mergedShape.back() *= shape[i];
+            mergedDst.back() = dstStrides[i];
+            mergedSrc.back() = srcStrides[i];
+            continue;
+        }
+        mergedShape.push_back(shape[i]);
+        mergedDst.push_back(dstStrides[i]);
+        mergedSrc.push_back(srcStrides[i]);
+    }
+    if (mergedShape.empty())
+    {
+        /** A single element */
+        std::memcpy(dst, src, elementSize);
+        return;
+    }
+    CopyStridedDims(static_cast<uint8_t*>(dst), mergedDst.data(), static_cast<const uint8_t*>(src), mergedSrc.data(),
+        mergedShape.data(), mergedShape.size(), elementSize);
+}
+
+static std::vector<int64_t> GetByteStrides(const Ortpy::InputArray& array)
+{
+    std::vector<int64_t> strides(array.ndim());
+    for (size_t i = 0; i < array.ndim(); i++)
+    {
+        strides[i] = array.stride(i) * static_cast<int64_t>(array.itemsize());
+    }
+    return strides;
+}
+
+static std::vector<int64_t> GetDenseByteStrides(const int64_t* shape, size_t ndim, size_t elementSize)
+{
+    std::vector<int64_t> strides(ndim);
+    int64_t stride = static_cast<int64_t>(elementSize);
+    for (size_t i = ndim; i-- > 0;)
+    {
+        strides[i] = stride;
+        stride *= shape[i];
+    }
+    return strides;
+}
+
+/** Repacks an array into a dense buffer of at least nbytes. */
+static void RepackArray(const Ortpy::InputArray& array, void* dst)
+{
+    auto srcStrides = GetByteStrides(array);
+    auto dstStrides = GetDenseByteStrides(array.shape_ptr(), array.ndim(), array.itemsize());
+    CopyStrided(dst, dstStrides.data(), array.data(), srcStrides.data(),
+        array.shape_ptr(), array.ndim(), array.itemsize());
+}
+
+/** The low nibble holds the first element of each byte. */
+static void PackInt4(const uint8_t* src, uint8_t* dst, size_t count)
+{
+    for (size_t i = 0; i + 1 < count; i += 2)
+    {
+        dst[i / 2] = static_cast<uint8_t>((src[i] & 0x0f) | ((src[i + 1] & 0x0f) << 4));
+    }
+    if (count % 2 == 1)
+    {
+        dst[count / 2] = src[count - 1] & 0x0f;
+    }
+}
+
+static void UnpackInt4(const uint8_t* src, uint8_t* dst, size_t count, bool isSigned)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t nibble = (src[i / 2] >> ((i % 2) * 4)) & 0x0f;
+        /** Sign extend through the high nibble. */
+        dst[i] = isSigned ? static_cast<uint8_t>(static_cast<int8_t>(nibble << 4) >> 4) : nibble;
+    }
+}
+
+static size_t GetUtf8Length(uint32_t codePoint)
+{
+    return codePoint < 0x80 ? 1 : codePoint < 0x800 ? 2 : codePoint < 0x10000 ? 3 : 4;
+}
+
+/** Writes the code point and returns the end of it. */
+static char* EncodeUtf8(char* out, uint32_t codePoint)
+{
+    if (codePoint < 0x80)
+    {
+        *out++ = static_cast<char>(codePoint);
+    }
+    else if (codePoint < 0x800)
+    {
+        *out++ = static_cast<char>(0xc0 | (codePoint >> 6));
+        *out++ = static_cast<char>(0x80 | (codePoint & 0x3f));
+    }
+    else if (codePoint < 0x10000)
+    {
+        *out++ = static_cast<char>(0xe0 | (codePoint >> 12));
+        *out++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+        *out++ = static_cast<char>(0x80 | (codePoint & 0x3f));
+    }
+    else
+    {
+        *out++ = static_cast<char>(0xf0 | (codePoint >> 18));
+        *out++ = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3f));
+        *out++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f));
+        *out++ = static_cast<char>(0x80 | (codePoint & 0x3f));
+    }
+    return out;
+}
+
+/** The type of the tensor created from an array. A raw view array takes the expected type. */
+static ONNXTensorElementDataType GetTensorType(const Ortpy::InputArray& npArray, ONNXTensorElementDataType expectedType)
+{
+    if (Ortpy::Value::IsRawViewType(expectedType) && Ortpy::Value::OrtTypeToNpType(expectedType) == npArray.dtype())
+    {
+        return expectedType;
+    }
+    return Ortpy::Value::NpTypeToOrtType(npArray.dtype());
+}
+
+static OrtValue* CreateTensorFromArray(const Ortpy::InputArray& npArray, void* data = nullptr,
+    ONNXTensorElementDataType type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED)
+{
+    if (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED)
+    {
+        type = Ortpy::Value::NpTypeToOrtType(npArray.dtype());
+    }
+    bool isPacked = Ortpy::Value::IsPackedType(type);
+    /** The shape of a dlpack tensor is already int64. No need to convert. */
+    if (data == nullptr && (isPacked || !IsCContiguous(npArray)))
+    {
+        throw std::runtime_error("The array must be repacked before creating a tensor from it");
+    }
+    OrtValue* value = nullptr;
+    Ortpy::Status status = Ortpy::GetApi()->CreateTensorWithDataAsOrtValue(
+        Ortpy::GetCpuMemoryInfo(),
+        data ? data : npArray.data(),
+        isPacked ? (npArray.size() + 1) / 2 : npArray.nbytes(),
+        npArray.shape_ptr(),
+        npArray.ndim(),
+        type,
+        &value);
+    status.Check();
+    return value;
+}
+
+/**
+ * A tensor of the array. Strided arrays and packed types are repacked into a buffer from the arena,
+ *     which is counted as repacked bytes. The buffer, or the array if it is used in place, must outlive the tensor.
+ */
+static OrtValue* CreateTensorInArena(const Ortpy::InputArray& array, ONNXTensorElementDataType type,
+    Ortpy::ScratchArena& scratchArena, Ortpy::ScratchArena::Buffer& repacked)
+{
+    if (Ortpy::Value::IsPackedType(type))
+    {
+        /** A byte per element in the array. Pack two per byte. */
+        Ortpy::ScratchArena::Buffer dense;
+        auto src = static_cast<const uint8_t*>(array.data());
+        if (!IsCContiguous(array))
+        {
+            dense = scratchArena.Acquire(array.nbytes());
+            RepackArray(array, dense.GetData());
+            src = dense.GetData();
+        }
+        repacked = scratchArena.Acquire((array.size() + 1) / 2);
+        PackInt4(src, repacked.GetData(), array.size());
+        return CreateTensorFromArray(array, repacked.GetData(), type);
+    }
+    if (IsCContiguous(array))
+    {
+        return CreateTensorFromArray(array, nullptr, type);
+    }
+    repacked = scratchArena.Acquire(array.nbytes());
+    RepackArray(array, repacked.GetData());
+    return CreateTensorFromArray(array, repacked.GetData(), type);
+}
+
 std::unordered_map<std::string, std::string> Ortpy::KeyValuePairsToMap(const OrtKeyValuePairs* pairs)
 {
     std::unordered_map<std::string, std::string> map{};
@@ -164,12 +475,58 @@ void Ortpy::Status::ReleaseOrtType(OrtStatus* ptr)
     GetApi()->ReleaseStatus(ptr);
 }
 
+/** ThreadingOptions */
+
+void Ortpy::ThreadingOptions::ReleaseOrtType(OrtThreadingOptions* ptr)
+{
+    GetApi()->ReleaseThreadingOptions(ptr);
+}
+
+Ortpy::ThreadingOptions::ThreadingOptions()
+    : OrtTypeWrapper<OrtThreadingOptions, ThreadingOptions>(nullptr)
+{
+    Ortpy::Status status = GetApi()->CreateThreadingOptions(&_ptr);
+    status.Check();
+}
+
+void Ortpy::ThreadingOptions::SetGlobalIntraOpNumThreads(int intraOpNumThreads)
+{
+    Ortpy::Status status = GetApi()->SetGlobalIntraOpNumThreads(_ptr, intraOpNumThreads);
+    status.Check();
+}
+
+void Ortpy::ThreadingOptions::SetGlobalInterOpNumThreads(int interOpNumThreads)
+{
+    Ortpy::Status status = GetApi()->SetGlobalInterOpNumThreads(_ptr, interOpNumThreads);
+    status.Check();
+}
+
+void Ortpy::ThreadingOptions::SetGlobalSpinControl(bool allowSpinning)
+{
+    Ortpy::Status status = GetApi()->SetGlobalSpinControl(_ptr, allowSpinning ? 1 : 0);
+    status.Check();
+}
+
+void Ortpy::ThreadingOptions::SetGlobalDenormalAsZero()
+{
+    Ortpy::Status status = GetApi()->SetGlobalDenormalAsZero(_ptr);
+    status.Check();
+}
+
+void Ortpy::ThreadingOptions::SetGlobalIntraOpThreadAffinity(const std::string& affinity)
+{
+    Ortpy::Status status = GetApi()->SetGlobalIntraOpThreadAffinity(_ptr, affinity.c_str());
+    status.Check();
+}
+
 /** Env */
 
 std::shared_ptr<Ortpy::Env> Ortpy::Env::_instance = nullptr;
+std::mutex Ortpy::Env::_instanceMutex;
 
 std::shared_ptr<Ortpy::Env> Ortpy::Env::GetSingleton()
 {
+    std::lock_guard<std::mutex> lock(_instanceMutex);
     if (!_instance) 
     {
         _instance = std::shared_ptr<Ortpy::Env>(new Ortpy::Env());
@@ -177,6 +534,16 @@ std::shared_ptr<Ortpy::Env> Ortpy::Env::GetSingleton()
     return _instance;
 }
 
+void Ortpy::Env::InitializeWithGlobalThreadPools(const ThreadingOptions& options)
+{
+    std::lock_guard<std::mutex> lock(_instanceMutex);
+    if (_instance)
+    {
+        throw std::runtime_error("The environment is already created. Initialize it before creating any session.");
+    }
+    _instance = std::shared_ptr<Ortpy::Env>(new Ortpy::Env(options));
+}
+
 Ortpy::Env::Env()
     : OrtTypeWrapper<OrtEnv, Env>(nullptr)
 {
@@ -186,6 +553,16 @@ Ortpy::Env::Env()
     GetApi()->DisableTelemetryEvents(_ptr);
 }
 
+Ortpy::Env::Env(const ThreadingOptions& options)
+    : OrtTypeWrapper<OrtEnv, Env>(nullptr)
+{
+    Ortpy::Status status = GetApi()->CreateEnvWithGlobalThreadPools(
+        ORT_LOGGING_LEVEL_WARNING, "Ortpy", options, &_ptr);
+    status.Check();
+    /** Return value ignored */
+    GetApi()->DisableTelemetryEvents(_ptr);
+}
+
 void Ortpy::Env::ReleaseOrtType(OrtEnv* ptr)
 {
     GetApi()->ReleaseEnv(ptr);
@@ -219,6 +596,38 @@ std::vector<Ortpy::EpDevice> Ortpy::Env::GetEpDevices() const
     return devices;
 }
 
+/** PyBuffer */
+
+Ortpy::PyBuffer::PyBuffer(const nanobind::object& object)
+{
+    if (PyObject_GetBuffer(object.ptr(), &_view, PyBUF_SIMPLE) != 0)
+    {
+        nanobind::raise_python_error();
+    }
+}
+
+Ortpy::PyBuffer::~PyBuffer()
+{
+    /** May be the last reference to the object. */
+    nanobind::gil_scoped_acquire gil;
+    PyBuffer_Release(&_view);
+}
+
+const void* Ortpy::PyBuffer::GetData() const
+{
+    return _view.buf;
+}
+
+size_t Ortpy::PyBuffer::GetSize() const
+{
+    return static_cast<size_t>(_view.len);
+}
+
+bool Ortpy::PyBuffer::IsReadOnly() const
+{
+    return _view.readonly != 0;
+}
+
 /** ModelCompilationOptions */
 
 void Ortpy::ModelCompilationOptions::ReleaseOrtType(OrtModelCompilationOptions* ptr)
@@ -233,13 +642,15 @@ void Ortpy::ModelCompilationOptions::SetInputModelPath(const std::string& path)
     status.Check();
 }
 
-void Ortpy::ModelCompilationOptions::SetInputModelFromBuffer(const nanobind::bytes& modelBytes)
+void Ortpy::ModelCompilationOptions::SetInputModelFromBuffer(const nanobind::object& modelBytes)
 {
+    auto inputModel = std::make_shared<const PyBuffer>(modelBytes);
     Ortpy::Status status = GetApi()->GetCompileApi()->ModelCompilationOptions_SetInputModelFromBuffer(
         _ptr,
-        modelBytes.data(),
-        modelBytes.size());
+        inputModel->GetData(),
+        inputModel->GetSize());
     status.Check();
+    _inputModel = std::move(inputModel);
 }
 
 void Ortpy::ModelCompilationOptions::SetOutputModelExternalInitializersFile(
@@ -305,6 +716,59 @@ void Ortpy::LibraryHandle::ReleaseOrtType(void* ptr)
 #endif /** __linux__ || __APPLE__ */
 }
 
+/** Cache keys */
+
+/** A fast non cryptographic 64 bit hash, 8 bytes at a time. Only used to key caches. */
+static uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+{
+    constexpr uint64_t prime1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+    auto bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = seed ^ (static_cast<uint64_t>(size) * prime1);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes + i, 8);
+        hash ^= std::rotl(word * prime2, 31) * prime1;
+        hash = std::rotl(hash, 27) * prime1 + prime2;
+    }
+    for (; i < size; i++)
+    {
+        hash ^= bytes[i] * prime1;
+        hash = std::rotl(hash, 11) * prime2;
+    }
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime1;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static std::string ToHex(uint64_t value)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (size_t i = 16; i-- > 0; value >>= 4)
+    {
+        hex[i] = digits[value & 0xf];
+    }
+    return hex;
+}
+
+/** Identifies an initializer added to options. Graph optimizations fold its value into the model. */
+static std::string GetInitializerKey(const std::string& name, const Ortpy::Value& value)
+{
+    std::string key = "initializer=" + name + ":" + std::to_string(value.GetType()) + ":";
+    for (auto dim : value.GetShape())
+    {
+        key += std::to_string(dim) + ",";
+    }
+    key += ToHex(HashBytes(value.GetData(), value.GetSize(), 0)) + ";";
+    return key;
+}
+
 /** SessionOptions */
 
 Ortpy::SessionOptions::SessionOptions()
@@ -319,6 +783,25 @@ void Ortpy::SessionOptions::ReleaseOrtType(OrtSessionOptions* ptr)
     GetApi()->ReleaseSessionOptions(ptr);
 }
 
+Ortpy::SessionOptions Ortpy::SessionOptions::Clone() const
+{
+    OrtSessionOptions* options = nullptr;
+    Ortpy::Status status = GetApi()->CloneSessionOptions(_ptr, &options);
+    status.Check();
+    SessionOptions clone{ options };
+    clone._delegate = _delegate;
+    /** The clone refers to the same initializers. */
+    clone._initializers = _initializers;
+    clone._initializersKey = _initializersKey;
+    clone._compileCacheDirectory = _compileCacheDirectory;
+    clone._optimizedModelCacheDirectory = _optimizedModelCacheDirectory;
+    clone._graphOptimizationLevel = _graphOptimizationLevel;
+    clone._executionProviderKey = _executionProviderKey;
+    clone._configurationKey = _configurationKey;
+    clone._scratchArena = _scratchArena;
+    return clone;
+}
+
 void Ortpy::SessionOptions::SetOptimizedModelFilePath(const std::string& path)
 {
     Ortpy::Status status = GetApi()->SetOptimizedModelFilePath(
@@ -392,6 +875,7 @@ void Ortpy::SessionOptions::SetSessionGraphOptimizationLevel(
 {
     Ortpy::Status status = GetApi()->SetSessionGraphOptimizationLevel(_ptr, level);
     status.Check();
+    _graphOptimizationLevel = level;
 }
 
 void Ortpy::SessionOptions::SetIntraOpNumThreads(int intraOpNumThreads)
@@ -408,6 +892,50 @@ void Ortpy::SessionOptions::SetInterOpNumThreads(int interOpNumThreads)
     status.Check();
 }
 
+void Ortpy::SessionOptions::DisablePerSessionThreads()
+{
+    Ortpy::Status status = GetApi()->DisablePerSessionThreads(_ptr);
+    status.Check();
+}
+
+void Ortpy::SessionOptions::AddSessionConfigEntry(const std::string& key, const std::string& value)
+{
+    Ortpy::Status status = GetApi()->AddSessionConfigEntry(_ptr, key.c_str(), value.c_str());
+    status.Check();
+    _configurationKey += "config=" + key + "=" + value + ";";
+}
+
+void Ortpy::SessionOptions::AddFreeDimensionOverride(const std::string& dimensionDenotation, int64_t dimensionValue)
+{
+    Ortpy::Status status = GetApi()->AddFreeDimensionOverride(_ptr, dimensionDenotation.c_str(), dimensionValue);
+    status.Check();
+    _configurationKey += "denotation=" + dimensionDenotation + "=" + std::to_string(dimensionValue) + ";";
+}
+
+void Ortpy::SessionOptions::AddFreeDimensionOverrideByName(const std::string& dimensionName, int64_t dimensionValue)
+{
+    Ortpy::Status status = GetApi()->AddFreeDimensionOverrideByName(_ptr, dimensionName.c_str(), dimensionValue);
+    status.Check();
+    _configurationKey += "dimension=" + dimensionName + "=" + std::to_string(dimensionValue) + ";";
+}
+
+Ortpy::SessionOptions Ortpy::SessionOptions::WithFreeDimensionOverrides(
+    const std::unordered_map<std::string, int64_t>& dimensions) const
+{
+    SessionOptions specialized = Clone();
+    /** Sorted, so the cache keys do not depend on the order of the map. */
+    std::map<std::string, int64_t> sortedDimensions{ dimensions.begin(), dimensions.end() };
+    for (const auto& [name, value] : sortedDimensions)
+    {
+        if (value <= 0)
+        {
+            throw std::invalid_argument("Dimension " + name + " must be positive, got " + std::to_string(value));
+        }
+        specialized.AddFreeDimensionOverrideByName(name, value);
+    }
+    return specialized;
+}
+
 Ortpy::LibraryHandle Ortpy::SessionOptions::RegisterCustomOpsLibrary(const std::string& libraryPath)
 {
     void* handle = nullptr;
@@ -485,12 +1013,26 @@ void Ortpy::SessionOptions::AppendExecutionProvider_V2(
         epOptionValues.data(),
         epOptionKeys.size());
     status.Check();
+    for (const auto& device : epDevices)
+    {
+        _executionProviderKey += "ep=" + device.epName + "/" + device.epVendor + "/" +
+            std::to_string(device.device.type) + "/" +
+            std::to_string(device.device.vendorId) + "/" +
+            std::to_string(device.device.deviceId) + ";";
+    }
+    /** Sorted, so the key does not depend on the order of the map. */
+    std::map<std::string, std::string> sortedOptions{ epOptions.begin(), epOptions.end() };
+    for (const auto& [k, v] : sortedOptions)
+    {
+        _executionProviderKey += "option=" + k + "=" + v + ";";
+    }
 }
 
 void Ortpy::SessionOptions::SetEpSelectionPolicy(OrtExecutionProviderDevicePolicy policy)
 {
     Ortpy::Status status = GetApi()->SessionOptionsSetEpSelectionPolicy(_ptr, policy);
     status.Check();
+    _executionProviderKey += "policy=" + std::to_string(policy) + ";";
 }
 
 void Ortpy::SessionOptions::SetEpSelectionPolicyDelegate(const EpSelectionPolicyDelegate& delegate)
@@ -555,30 +1097,131 @@ void Ortpy::SessionOptions::SetEpSelectionPolicyDelegate(const EpSelectionPolicy
     status.Check();
 }
 
-Ortpy::ModelCompilationOptions Ortpy::SessionOptions::CreateModelCompilationOptions() const
+Ortpy::ScratchArena& Ortpy::SessionOptions::GetScratchArena()
 {
-    OrtModelCompilationOptions* options = nullptr;
-    Ortpy::Status status = GetApi()->GetCompileApi()->CreateModelCompilationOptionsFromSessionOptions(
-        *Env::GetSingleton(), _ptr, &options);
-    status.Check();
-    return ModelCompilationOptions{ options };
+    if (!_scratchArena)
+    {
+        _scratchArena = std::make_shared<ScratchArena>();
+    }
+    return *_scratchArena;
 }
 
-/** TypeInfo */
+uint64_t Ortpy::SessionOptions::GetRepackedBytes() const
+{
+    return _scratchArena ? _scratchArena->GetRepackedBytes() : 0;
+}
 
-void Ortpy::TypeInfo::ReleaseOrtType(OrtTypeInfo* ptr)
+void Ortpy::SessionOptions::AddInitializer(const std::string& name, const InputArray& array)
 {
-    GetApi()->ReleaseTypeInfo(ptr);
+    Value value{ array, ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED, &GetScratchArena() };
+    Ortpy::Status status = GetApi()->AddInitializer(_ptr, name.c_str(), value);
+    status.Check();
+    _initializersKey += GetInitializerKey(name, value);
+    _initializers.push_back(std::move(value));
 }
 
-/** TensorTypeAndShapeInfo */
+void Ortpy::SessionOptions::AddExternalInitializers(
+    const std::vector<std::string>& names, const std::vector<InputArray>& arrays)
+{
+    if (names.size() != arrays.size())
+    {
+        throw std::invalid_argument("names and arrays must have the same length");
+    }
+    std::vector<Value> values;
+    values.reserve(arrays.size());
+    std::vector<const char*> namesView;
+    namesView.reserve(names.size());
+    std::vector<const OrtValue*> valuesView;
+    valuesView.reserve(arrays.size());
+    std::string initializersKey;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        values.emplace_back(arrays[i], ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED, &GetScratchArena());
+        initializersKey += GetInitializerKey(names[i], values.back());
+        namesView.push_back(names[i].c_str());
+        valuesView.push_back(values.back());
+    }
+    Ortpy::Status status = GetApi()->AddExternalInitializers(
+        _ptr, namesView.data(), valuesView.data(), valuesView.size());
+    status.Check();
+    _initializers.insert(_initializers.end(),
+        std::make_move_iterator(values.begin()), std::make_move_iterator(values.end()));
+    _initializersKey += initializersKey;
+}
 
-void Ortpy::TensorTypeAndShapeInfo::ReleaseOrtType(OrtTensorTypeAndShapeInfo* ptr)
+const std::vector<Ortpy::Value>& Ortpy::SessionOptions::GetInitializers() const
 {
-    GetApi()->ReleaseTensorTypeAndShapeInfo(ptr);
+    return _initializers;
 }
 
-/** TensorInfo */
+const std::string& Ortpy::SessionOptions::GetInitializersKey() const
+{
+    return _initializersKey;
+}
+
+void Ortpy::SessionOptions::SetCompileCacheDirectory(const std::string& directory)
+{
+    _compileCacheDirectory = directory;
+}
+
+const std::string& Ortpy::SessionOptions::GetCompileCacheDirectory() const
+{
+    return _compileCacheDirectory;
+}
+
+void Ortpy::SessionOptions::SetOptimizedModelCacheDirectory(const std::string& directory)
+{
+    _optimizedModelCacheDirectory = directory;
+}
+
+const std::string& Ortpy::SessionOptions::GetOptimizedModelCacheDirectory() const
+{
+    return _optimizedModelCacheDirectory;
+}
+
+GraphOptimizationLevel Ortpy::SessionOptions::GetSessionGraphOptimizationLevel() const
+{
+    return _graphOptimizationLevel;
+}
+
+std::optional<std::string> Ortpy::SessionOptions::GetExecutionProviderKey() const
+{
+    if (_delegate)
+    {
+        return std::nullopt;
+    }
+    return _executionProviderKey;
+}
+
+const std::string& Ortpy::SessionOptions::GetConfigurationKey() const
+{
+    return _configurationKey;
+}
+
+Ortpy::ModelCompilationOptions Ortpy::SessionOptions::CreateModelCompilationOptions() const
+{
+    OrtModelCompilationOptions* options = nullptr;
+    Ortpy::Status status = GetApi()->GetCompileApi()->CreateModelCompilationOptionsFromSessionOptions(
+        *Env::GetSingleton(), _ptr, &options);
+    status.Check();
+    return ModelCompilationOptions{ options };
+}
+
+/** TypeInfo */
+
+void Ortpy::TypeInfo::ReleaseOrtType(OrtTypeInfo* ptr)
+{
+    GetApi()->ReleaseTypeInfo(ptr);
+}
+
+/** TensorTypeAndShapeInfo */
+
+void Ortpy::TensorTypeAndShapeInfo::ReleaseOrtType(OrtTensorTypeAndShapeInfo* ptr)
+{
+    GetApi()->ReleaseTensorTypeAndShapeInfo(ptr);
+}
+
+/** TensorInfo */
 
 Ortpy::TensorInfo::TensorInfo(const TypeInfo& typeInfo)
 {
@@ -586,6 +1229,11 @@ Ortpy::TensorInfo::TensorInfo(const TypeInfo& typeInfo)
     /** DO NOT free the tensorInfo. It's bind to the typeInfo */
     Ortpy::Status status = GetApi()->CastTypeInfoToTensorInfo(typeInfo, &tensorInfo);
     status.Check();
+    if (tensorInfo == nullptr)
+    {
+        /** Not a tensor. Leave it empty so the session can still be created. */
+        return;
+    }
     size_t dimCount = 0;
     status = GetApi()->GetDimensionsCount(tensorInfo, &dimCount);
     status.Check();
@@ -604,7 +1252,11 @@ Ortpy::TensorInfo::TensorInfo(const TypeInfo& typeInfo)
     ONNXTensorElementDataType type;
     status = GetApi()->GetTensorElementType(tensorInfo, &type);
     status.Check();
-    dtype = Ortpy::Value::OrtTypeToNpType(type);
+    this->type = type;
+    if (type != ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING)
+    {
+        dtype = Ortpy::Value::OrtTypeToNpType(type);
+    }
 }
 
 /** RunOptions */
@@ -675,482 +1327,3955 @@ void Ortpy::RunOptions::UnsetTerminate()
     status.Check();
 }
 
-/** Session */
-
-Ortpy::Session::Session(const std::string& modelPath, const SessionOptions& options)
-    : OrtTypeWrapper<OrtSession, Session>(nullptr)
-{
-    OrtSession* session = nullptr;
-    Ortpy::Status status = GetApi()->CreateSession(
-        *Ortpy::Env::GetSingleton(),
-        StringToOrtString(modelPath).c_str(),
-        options,
-        &session);
-    status.Check();
-    _ptr = session;
-}
-
-Ortpy::Session::Session(const nanobind::bytes& modelBytes, const SessionOptions& options)
-    : OrtTypeWrapper<OrtSession, Session>(nullptr)
+void Ortpy::RunOptions::AddConfigEntry(const std::string& key, const std::string& value)
 {
-    OrtSession* session = nullptr;
-    Ortpy::Status status = GetApi()->CreateSessionFromArray(
-        *Ortpy::Env::GetSingleton(),
-        modelBytes.data(),
-        modelBytes.size(),
-        options,
-        &session);
+    Ortpy::Status status = GetApi()->AddRunConfigEntry(_ptr, key.c_str(), value.c_str());
     status.Check();
-    _ptr = session;
 }
 
-void Ortpy::Session::ReleaseOrtType(OrtSession* ptr)
-{
-    GetApi()->ReleaseSession(ptr);
-}
+/** MappedFile */
 
-std::unordered_map<std::string, Ortpy::TensorInfo> Ortpy::Session::GetInputInfo() const
+/** ORT format models are flatbuffers with the ORTM file identifier. Only they can be used in place. */
+static bool IsOrtFormatModel(const void* data, size_t size)
 {
-    size_t inputCount = 0;
-    Ortpy::Status status = GetApi()->SessionGetInputCount(_ptr, &inputCount);
-    status.Check();
-    std::unordered_map<std::string, Ortpy::TensorInfo> inputInfo;
-    auto allocator = GetAllocator();
-    for (size_t i = 0; i < inputCount; i++)
-    {
-        char* nameRaw = nullptr;
-        status = GetApi()->SessionGetInputName(_ptr, i, allocator, &nameRaw);
-        status.Check();
-        std::string name{ nameRaw };
-        allocator->Free(allocator, nameRaw);
-
-        OrtTypeInfo* typeInfoRaw = nullptr;
-        status = GetApi()->SessionGetInputTypeInfo(_ptr, i, &typeInfoRaw);
-        status.Check();
-        TypeInfo typeInfo{ typeInfoRaw };
-        inputInfo.emplace(name, TensorInfo{ typeInfo });
-    }
-    return inputInfo;
+    return size >= 8 && std::memcmp(static_cast<const uint8_t*>(data) + 4, "ORTM", 4) == 0;
 }
 
-std::unordered_map<std::string, Ortpy::TensorInfo> Ortpy::Session::GetOutputInfo() const
+Ortpy::MappedFile::MappedFile(const std::string& path)
 {
-    size_t outputCount = 0;
-    Ortpy::Status status = GetApi()->SessionGetOutputCount(_ptr, &outputCount);
-    status.Check();
-    std::unordered_map<std::string, Ortpy::TensorInfo> outputInfo;
-    auto allocator = GetAllocator();
-    for (size_t i = 0; i < outputCount; i++)
+#ifdef _WIN32
+    HANDLE file = CreateFileW(
+        StringToWString(path).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
     {
-        char* nameRaw = nullptr;
-        status = GetApi()->SessionGetOutputName(_ptr, i, allocator, &nameRaw);
-        status.Check();
-        std::string name{ nameRaw };
-        allocator->Free(allocator, nameRaw);
-
-        OrtTypeInfo* typeInfoRaw = nullptr;
-        status = GetApi()->SessionGetOutputTypeInfo(_ptr, i, &typeInfoRaw);
-        status.Check();
-        TypeInfo typeInfo{ typeInfoRaw };
-        outputInfo.emplace(name, TensorInfo{ typeInfo });
+        throw std::runtime_error("Failed to open " + path);
     }
-    return outputInfo;
-}
-
-std::unordered_map<std::string, Ortpy::NpArray> Ortpy::Session::Run(
-    const std::unordered_map<std::string, Ortpy::NpArray>& inputs,
-    const std::optional<std::vector<std::string>>& outputNamesOpt,
-    const std::optional<std::reference_wrapper<Ortpy::RunOptions>>& runOptionsOpt) const
-{
-    /** Create input values */
-    std::vector<const char*> inputNamesView;
-    inputNamesView.reserve(inputs.size());
-    std::vector<Value> inputValues;
-    inputValues.reserve(inputs.size());
-    std::vector<OrtValue*> inputValuesView;
-    inputValuesView.reserve(inputs.size());
-    for (const auto& pair : inputs)
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
     {
-        inputNamesView.emplace_back(pair.first.c_str());
-        Value value{ pair.second };
-        inputValuesView.emplace_back(value);
-        /** move won't affect the raw pointer in the view array. */
-        inputValues.emplace_back(std::move(value));
+        CloseHandle(file);
+        throw std::runtime_error("Failed to get the size of " + path);
     }
-    /** Create output values (part 1) */
-    std::vector<std::string> outputNames;
-    std::vector<const char*> outputNamesView;
-    if (outputNamesOpt.has_value())
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    /** The view keeps the mapping alive. The handles are no longer needed. */
+    CloseHandle(file);
+    if (mapping == nullptr)
     {
-        outputNames = outputNamesOpt.value();
+        throw std::runtime_error("Failed to map " + path);
     }
-    else
+    _data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (_data == nullptr)
     {
-        auto outputInfo = GetOutputInfo();
-        outputNames.reserve(outputInfo.size());
-        for (const auto& pair : outputInfo)
-        {
-            outputNames.push_back(pair.first);
-        }
+        throw std::runtime_error("Failed to map " + path);
     }
-    outputNamesView.reserve(outputNames.size());
-    for (const auto& name : outputNames)
+    _size = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
     {
-        outputNamesView.push_back(name.c_str());
+        throw std::runtime_error("Failed to open " + path);
     }
-    /** Let ort allocate the output values as we may not known their shapes */
-    std::vector<OrtValue*> outputValues(outputNamesView.size(), nullptr);
-    std::vector<Value> outputValuesWrapper;
-    outputValuesWrapper.reserve(outputNamesView.size());
-    /** Run the session */
-    Ortpy::Status status = GetApi()->Run(
-        _ptr, runOptionsOpt.has_value() ? runOptionsOpt.value().get() : nullptr,
-        inputNamesView.data(), inputValuesView.data(), inputs.size(),
-        outputNamesView.data(), outputNamesView.size(), outputValues.data());
-    status.Check();
-    /** Create output values (part 2) */
-    for (auto value : outputValues)
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
     {
-        /** safe guard the raw values first. */
-        outputValuesWrapper.emplace_back(value);
+        close(fd);
+        throw std::runtime_error("Failed to get the size of " + path);
     }
-    std::unordered_map<std::string, NpArray> outputs;
-    size_t i = 0;
-    for (const auto& name : outputNames)
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    /** The mapping keeps the file alive. The descriptor is no longer needed. */
+    close(fd);
+    if (data == MAP_FAILED)
     {
-        outputs[name] = outputValuesWrapper[i++];
+        throw std::runtime_error("Failed to map " + path);
     }
-    return outputs;
+    _data = data;
+    _size = static_cast<size_t>(st.st_size);
+#endif /** _WIN32 */
 }
 
-/** Value */
+Ortpy::MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+#else
+    munmap(_data, _size);
+#endif /** _WIN32 */
+}
 
-Ortpy::Value::State::~State()
+const void* Ortpy::MappedFile::GetData() const
 {
-    if (ortValue != nullptr)
-    {
-        GetApi()->ReleaseValue(ortValue);
-    }
+    return _data;
 }
 
-Ortpy::Value::Value(OrtValue* ptr)
+size_t Ortpy::MappedFile::GetSize() const
 {
-    if (ptr == nullptr)
+    return _size;
+}
+
+/** Compile cache */
+
+/**
+ * 64 bits of the model content and 64 bits of everything else. Not a digest: the cache trusts whoever can
+ *     write to its directory. The odds of an accidental collision are about n^2 / 2^65 for n cached models,
+ *     which is negligible, and hashing stays fast enough to run on every session creation.
+ */
+static std::string GetModelCacheKey(const void* data, size_t size, const std::string& configuration)
+{
+    std::string key = ToHex(HashBytes(data, size, 0));
+    key += '-';
+    key += ToHex(HashBytes(configuration.data(), configuration.size(), 0));
+    return key;
+}
+
+/** Atomically moves a fully written temporary file into the cache. Losing a race to another writer is fine. */
+static void PublishCacheFile(const std::filesystem::path& temporary, const std::filesystem::path& target)
+{
+    std::error_code error;
+    std::filesystem::rename(temporary, target, error);
+    if (error)
     {
-        /** Create an empty value */
-        return;
+        std::filesystem::remove(temporary, error);
+        if (!std::filesystem::exists(target))
+        {
+            throw std::runtime_error("Failed to store " + PathToUtf8(target) + " in the cache");
+        }
     }
-    _state->ortValue = ptr;
-    auto npType = OrtTypeToNpType(GetType());
-    auto ortShape = GetShape();
-    std::vector<size_t> npShape(ortShape.begin(), ortShape.end());
-    auto sharedStateHeldByNpArray = new std::shared_ptr<State>(_state);
-    nanobind::capsule owner(sharedStateHeldByNpArray, [](void* p) noexcept {
-        delete static_cast<std::shared_ptr<std::vector<uint8_t>>*>(p);
-    });
-    _state->npArray = NpArray(
-        GetData(),
-        npShape.size(),
-        npShape.data(),
-        owner,
-        nullptr,
-        npType);
 }
 
-Ortpy::Value::Value(const NpArray& npArray)
+static std::filesystem::path GetTemporaryCachePath(const std::filesystem::path& target)
+{
+    std::random_device random;
+    uint64_t suffix = (static_cast<uint64_t>(random()) << 32) | random();
+    /** Keep the extension, as ort may look at it. */
+    auto temporary = target;
+    temporary.replace_extension("." + ToHex(suffix) + ".tmp" + target.extension().string());
+    return temporary;
+}
+
+/**
+ * Returns the cached EP context model compiled from the given model, compiling and storing it on a miss.
+ * None when the cache is not enabled, when no execution provider is selected, as the CPU alone has nothing
+ *     to compile, or when the execution providers are only known at creation.
+ * The content of external data files is not part of the key.
+ */
+static std::optional<std::string> FindOrCompileModel(
+    const Ortpy::SessionOptions& options,
+    const void* data,
+    size_t size,
+    const std::function<void(Ortpy::ModelCompilationOptions&)>& setInputModel)
 {
-    /** npArray (indirectly) holds the data, the Value holds a reference. */
-    auto ortType = NpTypeToOrtType(npArray.dtype());
-    std::vector<int64_t> ortShape;
-    auto ndim = npArray.ndim();
-    ortShape.reserve(ndim);
-    for (int i = 0; i < ndim; i++)
+    const std::string& directory = options.GetCompileCacheDirectory();
+    auto executionProviderKey = options.GetExecutionProviderKey();
+    if (directory.empty() || !executionProviderKey || executionProviderKey->empty())
     {
-        ortShape.push_back(npArray.shape(i));
+        return std::nullopt;
     }
-    Ortpy::MemoryInfo memInfo{};
-    Ortpy::Status status = GetApi()->CreateTensorWithDataAsOrtValue(
-        memInfo,
-        npArray.data(),
-        npArray.nbytes(),
-        ortShape.data(),
-        ortShape.size(),
-        ortType,
-        &_state->ortValue);
-    status.Check();
+    std::string configuration = *executionProviderKey;
+    configuration += options.GetConfigurationKey();
+    configuration += options.GetInitializersKey();
+    configuration += "ort=";
+    configuration += OrtGetApiBase()->GetVersionString();
+    std::filesystem::path target = Utf8ToPath(directory) /
+        ("compiled-" + GetModelCacheKey(data, size, configuration) + ".onnx");
+    if (std::filesystem::exists(target))
+    {
+        return PathToUtf8(target);
+    }
+    std::filesystem::create_directories(target.parent_path());
+    auto temporary = GetTemporaryCachePath(target);
+    try
+    {
+        Ortpy::ModelCompilationOptions compilationOptions = options.CreateModelCompilationOptions();
+        setInputModel(compilationOptions);
+        /** A single self contained file can be published atomically. */
+        compilationOptions.SetEpContextEmbedMode(true);
+        compilationOptions.CompileModelToFile(PathToUtf8(temporary));
+    }
+    catch (...)
+    {
+        std::error_code error;
+        std::filesystem::remove(temporary, error);
+        throw;
+    }
+    PublishCacheFile(temporary, target);
+    return PathToUtf8(target);
 }
 
-Ortpy::Value::Value(const std::vector<int64_t>& ortShape, ONNXTensorElementDataType ortType)
+static std::string ResolveCompiledModelPath(const std::string& modelPath, const Ortpy::SessionOptions& options)
 {
-    Ortpy::Status status = GetApi()->CreateTensorAsOrtValue(
-        GetAllocator(),
-        ortShape.data(),
-        ortShape.size(),
-        ortType,
-        &_state->ortValue);
-    status.Check();
-    auto npType = OrtTypeToNpType(ortType);
-    std::vector<size_t> npShape(ortShape.begin(), ortShape.end());
-    auto sharedStateHeldByNpArray = new std::shared_ptr<State>(_state);
-    nanobind::capsule owner(sharedStateHeldByNpArray, [](void* p) noexcept {
-        delete static_cast<std::shared_ptr<std::vector<uint8_t>>*>(p);
-    });
-    _state->npArray = NpArray(
-        GetData(),
-        npShape.size(),
-        npShape.data(),
-        owner,
-        nullptr,
-        npType);
+    if (options.GetCompileCacheDirectory().empty())
+    {
+        return modelPath;
+    }
+    Ortpy::MappedFile model{ modelPath };
+    auto compiledPath = FindOrCompileModel(options, model.GetData(), model.GetSize(),
+        [&](Ortpy::ModelCompilationOptions& compilationOptions) {
+            compilationOptions.SetInputModelPath(modelPath);
+        });
+    return compiledPath.value_or(modelPath);
 }
 
-Ortpy::Value::operator Ortpy::NpArray() const
+static std::optional<std::string> ResolveCompiledModelPath(
+    const nanobind::object& modelBytes, const Ortpy::SessionOptions& options)
 {
-    if (!_state->npArray.has_value())
+    if (options.GetCompileCacheDirectory().empty())
     {
-        throw std::runtime_error("Value does not hold a numpy array");
+        return std::nullopt;
     }
-    return *(_state->npArray);
+    Ortpy::PyBuffer model{ modelBytes };
+    return FindOrCompileModel(options, model.GetData(), model.GetSize(),
+        [&](Ortpy::ModelCompilationOptions& compilationOptions) {
+            compilationOptions.SetInputModelFromBuffer(modelBytes);
+        });
 }
 
-Ortpy::Value::operator OrtValue*() const
+/** Optimized model cache */
+
+/**
+ * Identifies the CPU. ort picks fusions and layouts for its instruction set, so an optimized model only fits
+ *     machines with the same one. None when the CPU cannot be identified.
+ */
+static const std::optional<std::string>& GetCpuKey()
 {
-    return _state->ortValue;
+    static const std::optional<std::string> key = []() -> std::optional<std::string> {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+        auto cpuid = [](uint32_t leaf, uint32_t subleaf, uint32_t* registers) {
+#ifdef _MSC_VER
+            int values[4];
+            __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+            std::memcpy(registers, values, sizeof(values));
+#else
+            __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+        };
+        uint32_t registers[4] = {};
+        cpuid(0, 0, registers);
+        uint32_t maxLeaf = registers[0];
+        /** The vendor is in ebx, edx and ecx. */
+        std::string key;
+        key.append(reinterpret_cast<const char*>(&registers[1]), 4);
+        key.append(reinterpret_cast<const char*>(&registers[3]), 4);
+        key.append(reinterpret_cast<const char*>(&registers[2]), 4);
+        /** The signature and the feature flags. ebx of leaf 1 differs between cores, so it is left out. */
+        cpuid(1, 0, registers);
+        key += ";" + ToHex(registers[0]) + ToHex((static_cast<uint64_t>(registers[2]) << 32) | registers[3]);
+        if (maxLeaf >= 7)
+        {
+            cpuid(7, 0, registers);
+            key += ";" + ToHex(registers[1]) + ToHex((static_cast<uint64_t>(registers[2]) << 32) | registers[3]);
+        }
+        cpuid(0x80000000, 0, registers);
+        if (registers[0] >= 0x80000004)
+        {
+            char brand[49] = {};
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                cpuid(0x80000002 + i, 0, registers);
+                std::memcpy(brand + i * 16, registers, 16);
+            }
+            key += ";";
+            key += brand;
+        }
+        return key;
+#elif defined(__APPLE__)
+        char brand[256] = {};
+        size_t size = sizeof(brand) - 1;
+        if (sysctlbyname("machdep.cpu.brand_string", brand, &size, nullptr, 0) != 0)
+        {
+            return std::nullopt;
+        }
+        return std::string(brand);
+#elif defined(__linux__)
+        /** The first processor is enough, the others share its instruction set. */
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string key;
+        std::string line;
+        while (std::getline(cpuinfo, line) && !line.empty())
+        {
+            for (const char* field : { "model name", "isa", "Features", "CPU implementer", "CPU part" })
+            {
+                if (line.rfind(field, 0) == 0)
+                {
+                    key += line + ";";
+                }
+            }
+        }
+        if (key.empty())
+        {
+            return std::nullopt;
+        }
+        return key;
+#else
+        return std::nullopt;
+#endif
+    }();
+    return key;
 }
 
-ONNXTensorElementDataType Ortpy::Value::GetType() const
+/**
+ * None when the cache is not enabled, or when the session may use other execution providers than the CPU.
+ * Those may compile nodes, which ort cannot save in ORT format.
+ */
+static std::optional<std::string> GetOptimizedModelCachePath(
+    const Ortpy::SessionOptions& options, const void* data, size_t size)
 {
-    if (_state->ortValue == nullptr)
+    const std::string& directory = options.GetOptimizedModelCacheDirectory();
+    auto executionProviderKey = options.GetExecutionProviderKey();
+    const auto& cpuKey = GetCpuKey();
+    if (directory.empty() || !executionProviderKey || !executionProviderKey->empty() || !cpuKey)
     {
-        throw std::runtime_error("Value is empty");
+        return std::nullopt;
     }
-    OrtTensorTypeAndShapeInfo *info = nullptr;
-    Ortpy::Status status = GetApi()->GetTensorTypeAndShape(_state->ortValue, &info);
-    status.Check();
-    ONNXTensorElementDataType type;
-    status = GetApi()->GetTensorElementType(info, &type);
-    status.Check();
-    return type;
+    std::string configuration = "cpu=" + *cpuKey + ";";
+    configuration += options.GetConfigurationKey();
+    configuration += options.GetInitializersKey();
+    configuration += "level=" + std::to_string(options.GetSessionGraphOptimizationLevel()) + ";";
+    configuration += "ort=";
+    configuration += OrtGetApiBase()->GetVersionString();
+    std::filesystem::path path = Utf8ToPath(directory) /
+        ("optimized-" + GetModelCacheKey(data, size, configuration) + ".ort");
+    return PathToUtf8(path);
 }
 
-std::vector<int64_t> Ortpy::Value::GetShape() const
+static std::optional<std::string> GetOptimizedModelCachePath(
+    const std::string& modelPath, const Ortpy::SessionOptions& options)
 {
-    if (_state->ortValue == nullptr)
+    if (options.GetOptimizedModelCacheDirectory().empty())
     {
-        throw std::runtime_error("Value is empty");
+        return std::nullopt;
     }
-    OrtTensorTypeAndShapeInfo *info = nullptr;
-    Ortpy::Status status = GetApi()->GetTensorTypeAndShape(_state->ortValue, &info);
-    status.Check();
-    size_t dimCount = 0;
-    status = GetApi()->GetDimensionsCount(info, &dimCount);
-    status.Check();
-    std::vector<int64_t> shape(dimCount);
-    status = GetApi()->GetDimensions(info, shape.data(), dimCount);
-    status.Check();
-    return shape;
+    Ortpy::MappedFile model{ modelPath };
+    return GetOptimizedModelCachePath(options, model.GetData(), model.GetSize());
 }
 
-size_t Ortpy::Value::GetSize() const
+static std::optional<std::string> GetOptimizedModelCachePath(
+    const nanobind::object& modelBytes, const Ortpy::SessionOptions& options)
 {
-    if (_state->ortValue == nullptr)
+    if (options.GetOptimizedModelCacheDirectory().empty())
+    {
+        return std::nullopt;
+    }
+    Ortpy::PyBuffer model{ modelBytes };
+    return GetOptimizedModelCachePath(options, model.GetData(), model.GetSize());
+}
+
+/** Session */
+
+Ortpy::Session::Session(const std::string& modelPath, const SessionOptions& options)
+    : Session(modelPath, options, false)
+{
+}
+
+Ortpy::Session::Session(const std::string& modelPath, const SessionOptions& options, bool memoryMap)
+    : OrtTypeWrapper<OrtSession, Session>(nullptr)
+{
+    std::string path = ResolveCompiledModelPath(modelPath, options);
+    auto createFromSource = [&](const SessionOptions& sourceOptions) {
+        if (memoryMap)
+        {
+            CreateFromMappedFile(std::make_shared<const MappedFile>(path), sourceOptions, nullptr);
+        }
+        else
+        {
+            _ptr = CreateFromPath(path, sourceOptions, nullptr);
+        }
+    };
+    /** A compiled model is not optimized again. */
+    auto cachePath = path == modelPath ? GetOptimizedModelCachePath(modelPath, options) : std::nullopt;
+    if (cachePath)
+    {
+        CreateWithOptimizedModelCache(*cachePath, options, memoryMap, createFromSource);
+    }
+    else
+    {
+        createFromSource(options);
+    }
+    _initializers = options.GetInitializers();
+    LoadMetadata();
+}
+
+Ortpy::Session::Session(const nanobind::object& modelBytes, const SessionOptions& options)
+    : OrtTypeWrapper<OrtSession, Session>(nullptr)
+{
+    auto compiledPath = ResolveCompiledModelPath(modelBytes, options);
+    auto cachePath = compiledPath ? std::nullopt : GetOptimizedModelCachePath(modelBytes, options);
+    if (compiledPath)
+    {
+        _ptr = CreateFromPath(*compiledPath, options, nullptr);
+    }
+    else if (cachePath)
+    {
+        CreateWithOptimizedModelCache(*cachePath, options, false, [&](const SessionOptions& sourceOptions) {
+            CreateFromPyBuffer(modelBytes, sourceOptions, nullptr);
+        });
+    }
+    else
+    {
+        CreateFromPyBuffer(modelBytes, options, nullptr);
+    }
+    _initializers = options.GetInitializers();
+    LoadMetadata();
+}
+
+Ortpy::Session::Session(const std::string& modelPath, const SessionOptions& options,
+    const PrepackedWeightsContainer& container)
+    : OrtTypeWrapper<OrtSession, Session>(nullptr)
+{
+    _ptr = CreateFromPath(modelPath, options, &container);
+    _initializers = options.GetInitializers();
+    LoadMetadata();
+}
+
+Ortpy::Session::Session(const nanobind::object& modelBytes, const SessionOptions& options,
+    const PrepackedWeightsContainer& container)
+    : OrtTypeWrapper<OrtSession, Session>(nullptr)
+{
+    CreateFromPyBuffer(modelBytes, options, &container);
+    _initializers = options.GetInitializers();
+    LoadMetadata();
+}
+
+Ortpy::Session::Session(const std::shared_ptr<const MappedFile>& model, const SessionOptions& options,
+    const PrepackedWeightsContainer& container)
+    : OrtTypeWrapper<OrtSession, Session>(nullptr)
+{
+    CreateFromMappedFile(model, options, &container);
+    _initializers = options.GetInitializers();
+    LoadMetadata();
+}
+
+/** Everything needed by a session created in the background. Only touched with the GIL held. */
+struct CreateAsyncContext
+{
+    std::string modelPath;
+    bool memoryMap{ false };
+    const Ortpy::SessionOptions* options{ nullptr };
+    /** Keeps the options alive until the session is created. */
+    nanobind::object optionsObject;
+    nanobind::object future;
+};
+
+nanobind::object Ortpy::Session::CreateAsync(const std::string& modelPath, const SessionOptions& options, bool memoryMap)
+{
+    auto context = std::make_unique<CreateAsyncContext>();
+    context->modelPath = modelPath;
+    context->memoryMap = memoryMap;
+    context->options = &options;
+    context->optionsObject = nanobind::find(&options);
+    context->future = nanobind::module_::import_("concurrent.futures").attr("Future")();
+    nanobind::object future = context->future;
+    std::thread([context = std::move(context)]() mutable {
+        /** Loading and optimizing the model do not need the GIL. */
+        std::unique_ptr<Session> session{ nullptr };
+        std::string error;
+        try
+        {
+            session = std::make_unique<Session>(context->modelPath, *context->options, context->memoryMap);
+        }
+        catch (const std::exception& ex)
+        {
+            error = ex.what();
+        }
+        nanobind::gil_scoped_acquire acquire;
+        try
+        {
+            if (session)
+            {
+                context->future.attr("set_result")(
+                    nanobind::cast(session.release(), nanobind::rv_policy::take_ownership));
+            }
+            else
+            {
+                context->future.attr("set_exception")(nanobind::handle(PyExc_RuntimeError)(error.c_str()));
+            }
+        }
+        catch (nanobind::python_error& ex)
+        {
+            ex.discard_as_unraisable("Session.create_async");
+        }
+        /** Release the python objects while holding the GIL. */
+        context.reset();
+    }).detach();
+    return future;
+}
+
+Ortpy::Session::~Session()
+{
+    /** Release the session before the mapped model it may still refer to. */
+    if (_ptr)
+    {
+        ReleaseOrtType(_ptr);
+        _ptr = nullptr;
+    }
+}
+
+void Ortpy::Session::ReleaseOrtType(OrtSession* ptr)
+{
+    GetApi()->ReleaseSession(ptr);
+}
+
+OrtSession* Ortpy::Session::CreateFromPath(const std::string& modelPath, const SessionOptions& options,
+    const PrepackedWeightsContainer* container)
+{
+    OrtSession* session = nullptr;
+    Ortpy::Status status{ nullptr };
+    if (container)
+    {
+        status = GetApi()->CreateSessionWithPrepackedWeightsContainer(
+            *Ortpy::Env::GetSingleton(),
+            StringToOrtString(modelPath).c_str(),
+            options,
+            *container,
+            &session);
+    }
+    else
+    {
+        status = GetApi()->CreateSession(
+            *Ortpy::Env::GetSingleton(),
+            StringToOrtString(modelPath).c_str(),
+            options,
+            &session);
+    }
+    status.Check();
+    return session;
+}
+
+OrtSession* Ortpy::Session::CreateFromBuffer(const void* data, size_t size, bool inPlace,
+    const SessionOptions& options, const PrepackedWeightsContainer* container)
+{
+    /**
+     * In place, ort uses the bytes directly instead of copying them, initializers included.
+     * The caller keeps the bytes alive for the lifetime of the session.
+     * Set on a copy, so the caller's options are left as they are.
+     */
+    std::optional<SessionOptions> inPlaceOptions{ std::nullopt };
+    if (inPlace)
+    {
+        inPlaceOptions = options.Clone();
+        Ortpy::Status status = GetApi()->AddSessionConfigEntry(
+            *inPlaceOptions, "session.use_ort_model_bytes_directly", "1");
+        status.Check();
+        status = GetApi()->AddSessionConfigEntry(
+            *inPlaceOptions, "session.use_ort_model_bytes_for_initializers", "1");
+        status.Check();
+    }
+    const OrtSessionOptions* sessionOptions = inPlaceOptions ? *inPlaceOptions : options;
+    OrtSession* session = nullptr;
+    Ortpy::Status status{ nullptr };
+    if (container)
+    {
+        status = GetApi()->CreateSessionFromArrayWithPrepackedWeightsContainer(
+            *Ortpy::Env::GetSingleton(),
+            data,
+            size,
+            sessionOptions,
+            *container,
+            &session);
+    }
+    else
+    {
+        status = GetApi()->CreateSessionFromArray(
+            *Ortpy::Env::GetSingleton(),
+            data,
+            size,
+            sessionOptions,
+            &session);
+    }
+    status.Check();
+    return session;
+}
+
+void Ortpy::Session::CreateFromMappedFile(const std::shared_ptr<const MappedFile>& model,
+    const SessionOptions& options, const PrepackedWeightsContainer* container)
+{
+    bool inPlace = IsOrtFormatModel(model->GetData(), model->GetSize());
+    _ptr = CreateFromBuffer(model->GetData(), model->GetSize(), inPlace, options, container);
+    if (inPlace)
+    {
+        _modelOwner = model;
+    }
+}
+
+void Ortpy::Session::CreateFromPyBuffer(const nanobind::object& modelBytes, const SessionOptions& options,
+    const PrepackedWeightsContainer* container)
+{
+    auto buffer = std::make_shared<const PyBuffer>(modelBytes);
+    /** A writable buffer may change under the session. Let ort copy it. */
+    bool inPlace = buffer->IsReadOnly() && IsOrtFormatModel(buffer->GetData(), buffer->GetSize());
+    _ptr = CreateFromBuffer(buffer->GetData(), buffer->GetSize(), inPlace, options, container);
+    if (inPlace)
+    {
+        _modelOwner = std::move(buffer);
+    }
+}
+
+void Ortpy::Session::CreateWithOptimizedModelCache(const std::string& cachePath, const SessionOptions& options,
+    bool memoryMap, const std::function<void(const SessionOptions&)>& createFromSource)
+{
+    std::filesystem::path target = Utf8ToPath(cachePath);
+    if (std::filesystem::exists(target))
+    {
+        /** Already optimized at the requested level. */
+        SessionOptions cachedOptions = options.Clone();
+        cachedOptions.SetSessionGraphOptimizationLevel(ORT_DISABLE_ALL);
+        if (memoryMap)
+        {
+            CreateFromMappedFile(std::make_shared<const MappedFile>(cachePath), cachedOptions, nullptr);
+        }
+        else
+        {
+            _ptr = CreateFromPath(cachePath, cachedOptions, nullptr);
+        }
+        return;
+    }
+    std::filesystem::create_directories(target.parent_path());
+    auto temporary = GetTemporaryCachePath(target);
+    /** This session is optimized anyway. Let it save the result on the side. */
+    SessionOptions savingOptions = options.Clone();
+    savingOptions.SetOptimizedModelFilePath(PathToUtf8(temporary));
+    Ortpy::Status status = GetApi()->AddSessionConfigEntry(savingOptions, "session.save_model_format", "ORT");
+    status.Check();
+    try
+    {
+        createFromSource(savingOptions);
+    }
+    catch (...)
+    {
+        /** Some graphs cannot be saved in ORT format. Create the session without the cache then. */
+        std::error_code error;
+        std::filesystem::remove(temporary, error);
+        createFromSource(options);
+        return;
+    }
+    PublishCacheFile(temporary, target);
+}
+
+void Ortpy::Session::LoadMetadata()
+{
+    auto allocator = GetAllocator();
+    size_t inputCount = 0;
+    Ortpy::Status status = GetApi()->SessionGetInputCount(_ptr, &inputCount);
+    status.Check();
+    _inputNames.reserve(inputCount);
+    _inputInfos.reserve(inputCount);
+    for (size_t i = 0; i < inputCount; i++)
+    {
+        char* nameRaw = nullptr;
+        status = GetApi()->SessionGetInputName(_ptr, i, allocator, &nameRaw);
+        status.Check();
+        _inputNames.emplace_back(nameRaw);
+        allocator->Free(allocator, nameRaw);
+
+        OrtTypeInfo* typeInfoRaw = nullptr;
+        status = GetApi()->SessionGetInputTypeInfo(_ptr, i, &typeInfoRaw);
+        status.Check();
+        TypeInfo typeInfo{ typeInfoRaw };
+        _inputInfos.emplace_back(typeInfo);
+        if (Value::IsRawViewType(_inputInfos.back().type))
+        {
+            _rawViewInputTypes.emplace(_inputNames.back(), _inputInfos.back().type);
+        }
+    }
+    size_t outputCount = 0;
+    status = GetApi()->SessionGetOutputCount(_ptr, &outputCount);
+    status.Check();
+    _outputNames.reserve(outputCount);
+    _outputInfos.reserve(outputCount);
+    for (size_t i = 0; i < outputCount; i++)
+    {
+        char* nameRaw = nullptr;
+        status = GetApi()->SessionGetOutputName(_ptr, i, allocator, &nameRaw);
+        status.Check();
+        _outputNames.emplace_back(nameRaw);
+        allocator->Free(allocator, nameRaw);
+
+        OrtTypeInfo* typeInfoRaw = nullptr;
+        status = GetApi()->SessionGetOutputTypeInfo(_ptr, i, &typeInfoRaw);
+        status.Check();
+        TypeInfo typeInfo{ typeInfoRaw };
+        _outputInfos.emplace_back(typeInfo);
+    }
+    /** The names will not move from now on. */
+    _inputNamesView.reserve(inputCount);
+    for (const auto& name : _inputNames)
+    {
+        _inputNamesView.push_back(name.c_str());
+    }
+    _outputNamesView.reserve(outputCount);
+    for (const auto& name : _outputNames)
+    {
+        _outputNamesView.push_back(name.c_str());
+    }
+}
+
+std::unordered_map<std::string, Ortpy::TensorInfo> Ortpy::Session::GetInputInfo() const
+{
+    std::unordered_map<std::string, Ortpy::TensorInfo> inputInfo;
+    for (size_t i = 0; i < _inputNames.size(); i++)
+    {
+        inputInfo.emplace(_inputNames[i], _inputInfos[i]);
+    }
+    return inputInfo;
+}
+
+std::unordered_map<std::string, Ortpy::TensorInfo> Ortpy::Session::GetOutputInfo() const
+{
+    std::unordered_map<std::string, Ortpy::TensorInfo> outputInfo;
+    for (size_t i = 0; i < _outputNames.size(); i++)
+    {
+        outputInfo.emplace(_outputNames[i], _outputInfos[i]);
+    }
+    return outputInfo;
+}
+
+const std::vector<std::string>& Ortpy::Session::GetInputNames() const
+{
+    return _inputNames;
+}
+
+const std::vector<std::string>& Ortpy::Session::GetOutputNames() const
+{
+    return _outputNames;
+}
+
+Ortpy::ScratchArena& Ortpy::Session::GetScratchArena() const
+{
+    return *_scratchArena;
+}
+
+uint64_t Ortpy::Session::GetRepackedBytes() const
+{
+    return _scratchArena->GetRepackedBytes();
+}
+
+std::string Ortpy::Session::EndProfiling()
+{
+    auto allocator = GetAllocator();
+    char* pathRaw = nullptr;
+    Ortpy::Status status = GetApi()->SessionEndProfiling(_ptr, allocator, &pathRaw);
+    status.Check();
+    std::string path = pathRaw ? pathRaw : "";
+    if (pathRaw)
+    {
+        allocator->Free(allocator, pathRaw);
+    }
+    return path;
+}
+
+uint64_t Ortpy::Session::GetProfilingStartTimeNs() const
+{
+    uint64_t startTime = 0;
+    Ortpy::Status status = GetApi()->SessionGetProfilingStartTimeNs(_ptr, &startTime);
+    status.Check();
+    return startTime;
+}
+
+Ortpy::RunMetrics& Ortpy::Session::GetRunMetrics() const
+{
+    return _metrics;
+}
+
+void Ortpy::Session::EnableMetrics(bool enabled)
+{
+    _metrics.SetEnabled(enabled);
+}
+
+void Ortpy::Session::ResetMetrics()
+{
+    _metrics.Reset();
+}
+
+std::unordered_map<std::string, uint64_t> Ortpy::Session::GetMetrics() const
+{
+    auto totals = _metrics.Snapshot();
+    std::unordered_map<std::string, uint64_t> metrics;
+    for (size_t i = 0; i < RunMetrics::NumCounters; i++)
+    {
+        metrics[RunMetrics::GetCounterName(static_cast<RunMetrics::Counter>(i))] = totals[i];
+    }
+    return metrics;
+}
+
+std::string Ortpy::Session::GetMetricsText(const std::string& sessionName) const
+{
+    auto totals = _metrics.Snapshot();
+    std::string labels;
+    if (!sessionName.empty())
+    {
+        /** Label values escape backslashes, quotes and new lines. */
+        std::string escaped;
+        for (char c : sessionName)
+        {
+            if (c == '\\' || c == '"')
+            {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if (c == '\n')
+            {
+                escaped += "\\n";
+            }
+            else
+            {
+                escaped += c;
+            }
+        }
+        labels = "{session=\"" + escaped + "\"}";
+    }
+    struct Metric
+    {
+        const char* name;
+        const char* help;
+        RunMetrics::Counter counter;
+        /** Nanoseconds are exported as seconds. */
+        bool isTime;
+    };
+    static const Metric metrics[] = {
+        { "ortpy_session_runs_total", "Number of runs.", RunMetrics::Calls, false },
+        { "ortpy_session_input_seconds_total", "Time spent marshalling inputs.", RunMetrics::InputNs, true },
+        { "ortpy_session_run_seconds_total", "Time spent in the ort run.", RunMetrics::RunNs, true },
+        { "ortpy_session_output_seconds_total", "Time spent wrapping outputs.", RunMetrics::OutputNs, true },
+        { "ortpy_session_input_bytes_total", "Bytes of input tensors.", RunMetrics::BytesIn, false },
+        { "ortpy_session_output_bytes_total", "Bytes of output tensors.", RunMetrics::BytesOut, false },
+    };
+    std::string text;
+    for (const auto& metric : metrics)
+    {
+        uint64_t value = totals[metric.counter];
+        text += std::string("# HELP ") + metric.name + " " + metric.help + "\n";
+        text += std::string("# TYPE ") + metric.name + " counter\n";
+        text += metric.name + labels + " ";
+        text += metric.isTime ? std::to_string(static_cast<double>(value) / 1e9) : std::to_string(value);
+        text += "\n";
+    }
+    return text;
+}
+
+nanobind::dict Ortpy::Session::Run(
+    const std::unordered_map<std::string, Ortpy::SessionInput>& inputs,
+    const std::optional<std::vector<std::string>>& outputNames,
+    const std::optional<std::reference_wrapper<Ortpy::RunOptions>>& runOptions,
+    ArrayFramework outputFramework) const
+{
+    RunMetrics::Stopwatch stopwatch{ _metrics };
+    return Run(inputs, outputNames, runOptions, outputFramework, stopwatch);
+}
+
+nanobind::dict Ortpy::Session::Run(
+    const nanobind::dict& inputs,
+    const std::optional<std::vector<std::string>>& outputNames,
+    const std::optional<std::reference_wrapper<Ortpy::RunOptions>>& runOptions,
+    ArrayFramework outputFramework) const
+{
+    RunMetrics::Stopwatch stopwatch{ _metrics };
+    /** The converted arrays hold references to the python objects, which the caller keeps alive. */
+    std::unordered_map<std::string, SessionInput> converted;
+    converted.reserve(inputs.size());
+    for (auto [key, value] : inputs)
+    {
+        auto name = nanobind::cast<std::string>(key);
+        SessionInput input;
+        if (!nanobind::try_cast(value, input))
+        {
+            throw std::invalid_argument("Input " + name + " is neither an array nor a StringTensor");
+        }
+        converted.emplace(std::move(name), std::move(input));
+    }
+    return Run(converted, outputNames, runOptions, outputFramework, stopwatch);
+}
+
+nanobind::dict Ortpy::Session::Run(
+    const std::unordered_map<std::string, Ortpy::SessionInput>& inputs,
+    const std::optional<std::vector<std::string>>& outputNamesOpt,
+    const std::optional<std::reference_wrapper<Ortpy::RunOptions>>& runOptionsOpt,
+    ArrayFramework outputFramework,
+    RunMetrics::Stopwatch& stopwatch) const
+{
+    /** Create input values. They never escape the run, so views are enough. */
+    std::vector<const char*> inputNamesView;
+    inputNamesView.reserve(inputs.size());
+    std::vector<TensorView> inputValues;
+    inputValues.reserve(inputs.size());
+    std::vector<OrtValue*> inputValuesView;
+    inputValuesView.reserve(inputs.size());
+    for (const auto& pair : inputs)
+    {
+        inputNamesView.emplace_back(pair.first.c_str());
+        if (auto strings = std::get_if<std::reference_wrapper<StringTensor>>(&pair.second))
+        {
+            /** Already a tensor, kept alive by the caller's arguments. */
+            const Value& value = strings->get().GetValue();
+            inputValuesView.emplace_back(value);
+            if (stopwatch.IsEnabled())
+            {
+                stopwatch.Add(RunMetrics::BytesIn, value.GetSize());
+            }
+            continue;
+        }
+        const auto& array = std::get<InputArray>(pair.second);
+        inputValues.emplace_back(array, *_scratchArena, GetRawViewInputType(pair.first));
+        inputValuesView.emplace_back(inputValues.back());
+        stopwatch.Add(RunMetrics::BytesIn, array.nbytes());
+    }
+    /** Create output values (part 1) */
+    const auto& outputNames = outputNamesOpt.has_value() ? outputNamesOpt.value() : _outputNames;
+    std::vector<const char*> requestedNamesView;
+    if (outputNamesOpt.has_value())
+    {
+        requestedNamesView.reserve(outputNames.size());
+        for (const auto& name : outputNames)
+        {
+            requestedNamesView.push_back(name.c_str());
+        }
+    }
+    const auto& outputNamesView = outputNamesOpt.has_value() ? requestedNamesView : _outputNamesView;
+    /** Let ort allocate the output values as we may not known their shapes */
+    std::vector<OrtValue*> outputValues(outputNamesView.size(), nullptr);
+    std::vector<Value> outputValuesWrapper;
+    outputValuesWrapper.reserve(outputNamesView.size());
+    stopwatch.Lap(RunMetrics::InputNs);
+    /** Run the session */
+    Ortpy::Status status{ nullptr };
+    {
+        /**
+         * The inputs and run options are kept alive by the caller's arguments,
+         *     so it's safe to let other python threads run in the meantime.
+         */
+        nanobind::gil_scoped_release release;
+        status = GetApi()->Run(
+            _ptr, runOptionsOpt.has_value() ? runOptionsOpt.value().get() : nullptr,
+            inputNamesView.data(), inputValuesView.data(), inputs.size(),
+            outputNamesView.data(), outputNamesView.size(), outputValues.data());
+    }
+    stopwatch.Lap(RunMetrics::RunNs);
+    status.Check();
+    /** Create output values (part 2) */
+    for (auto value : outputValues)
+    {
+        /** safe guard the raw values first. */
+        outputValuesWrapper.emplace_back(value);
+    }
+    nanobind::dict outputs;
+    size_t i = 0;
+    for (const auto& name : outputNames)
+    {
+        outputs[name.c_str()] = outputValuesWrapper[i++].ToPython(outputFramework);
+    }
+    if (stopwatch.IsEnabled())
+    {
+        for (const auto& value : outputValuesWrapper)
+        {
+            stopwatch.Add(RunMetrics::BytesOut, value.GetSize());
+        }
+    }
+    stopwatch.Lap(RunMetrics::OutputNs);
+    return outputs;
+}
+
+ONNXTensorElementDataType Ortpy::Session::GetRawViewInputType(const std::string& name) const
+{
+    if (_rawViewInputTypes.empty())
+    {
+        return ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+    }
+    auto it = _rawViewInputTypes.find(name);
+    return it != _rawViewInputTypes.end() ? it->second : ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+}
+
+/** Everything RunAsync hands over to ort must live until the callback. */
+struct RunAsyncContext
+{
+    nanobind::object session;
+    nanobind::object runOptions;
+    nanobind::object future;
+    Ortpy::ArrayFramework outputFramework{ Ortpy::ArrayFramework::Numpy };
+    std::vector<std::string> inputNames;
+    std::vector<const char*> inputNamesView;
+    std::vector<Ortpy::Value> inputValues;
+    std::vector<OrtValue*> inputValuesView;
+    std::vector<std::string> outputNames;
+    std::vector<const char*> outputNamesView;
+    std::vector<OrtValue*> outputValues;
+};
+
+static void RunAsyncCallback(void* userData, OrtValue** outputs, size_t numOutputs, OrtStatusPtr statusRaw) noexcept
+{
+    /** The status is ours to release. */
+    Ortpy::Status status{ statusRaw };
+    /** This is called from an ort thread. Only take the GIL to publish the result. */
+    nanobind::gil_scoped_acquire acquire;
+    std::unique_ptr<RunAsyncContext> context{ static_cast<RunAsyncContext*>(userData) };
+    try
+    {
+        std::vector<Ortpy::Value> outputValuesWrapper;
+        outputValuesWrapper.reserve(numOutputs);
+        for (size_t i = 0; i < numOutputs; i++)
+        {
+            /** safe guard the raw values first. */
+            outputValuesWrapper.emplace_back(outputs[i]);
+        }
+        status.Check();
+        nanobind::dict result;
+        for (size_t i = 0; i < numOutputs; i++)
+        {
+            result[context->outputNames[i].c_str()] = outputValuesWrapper[i].ToPython(context->outputFramework);
+        }
+        context->future.attr("set_result")(result);
+    }
+    catch (nanobind::python_error& ex)
+    {
+        /** e.g. The future is already cancelled. There is no one to report to. */
+        ex.discard_as_unraisable("RunAsyncCallback");
+    }
+    catch (const std::exception& ex)
+    {
+        try
+        {
+            context->future.attr("set_exception")(nanobind::handle(PyExc_RuntimeError)(ex.what()));
+        }
+        catch (nanobind::python_error& pyEx)
+        {
+            pyEx.discard_as_unraisable("RunAsyncCallback");
+        }
+    }
+}
+
+nanobind::object Ortpy::Session::RunAsync(
+    const std::unordered_map<std::string, Ortpy::InputArray>& inputs,
+    const std::optional<std::vector<std::string>>& outputNamesOpt,
+    const std::optional<std::reference_wrapper<Ortpy::RunOptions>>& runOptionsOpt,
+    ArrayFramework outputFramework) const
+{
+    auto context = std::make_unique<RunAsyncContext>();
+    context->outputFramework = outputFramework;
+    /** Keep the session and run options alive until the callback. */
+    context->session = nanobind::find(this);
+    if (runOptionsOpt.has_value())
+    {
+        context->runOptions = nanobind::find(&runOptionsOpt.value().get());
+    }
+    context->future = nanobind::module_::import_("concurrent.futures").attr("Future")();
+    /** Create input values. The caller's map is gone after return, so copy the names. */
+    context->inputNames.reserve(inputs.size());
+    context->inputValues.reserve(inputs.size());
+    for (const auto& pair : inputs)
+    {
+        context->inputNames.push_back(pair.first);
+        context->inputValues.emplace_back(pair.second, GetRawViewInputType(pair.first), _scratchArena.get());
+    }
+    context->inputNamesView.reserve(inputs.size());
+    context->inputValuesView.reserve(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        context->inputNamesView.push_back(context->inputNames[i].c_str());
+        context->inputValuesView.push_back(context->inputValues[i]);
+    }
+    /** Create output names */
+    context->outputNames = outputNamesOpt.has_value() ? outputNamesOpt.value() : _outputNames;
+    context->outputNamesView.reserve(context->outputNames.size());
+    for (const auto& name : context->outputNames)
+    {
+        context->outputNamesView.push_back(name.c_str());
+    }
+    /** Let ort allocate the output values as we may not known their shapes */
+    context->outputValues.resize(context->outputNames.size(), nullptr);
+    nanobind::object future = context->future;
+    /** Owned by the callback from now on. It may be freed before RunAsync returns. */
+    RunAsyncContext* contextRaw = context.release();
+    Ortpy::Status status{ nullptr };
+    {
+        nanobind::gil_scoped_release release;
+        status = GetApi()->RunAsync(
+            _ptr, runOptionsOpt.has_value() ? runOptionsOpt.value().get() : nullptr,
+            contextRaw->inputNamesView.data(), contextRaw->inputValuesView.data(), contextRaw->inputValuesView.size(),
+            contextRaw->outputNamesView.data(), contextRaw->outputNamesView.size(), contextRaw->outputValues.data(),
+            RunAsyncCallback, contextRaw);
+    }
+    if (status.GetErrorCode() != ORT_OK)
+    {
+        /** The callback will not be called if the run fails to start. */
+        context.reset(contextRaw);
+    }
+    status.Check();
+    return future;
+}
+
+void Ortpy::Session::RunWithBinding(
+    const IoBinding& binding,
+    const std::optional<std::reference_wrapper<Ortpy::RunOptions>>& runOptionsOpt) const
+{
+    Ortpy::Status status{ nullptr };
+    {
+        /** The bound arrays are kept alive by the binding. */
+        nanobind::gil_scoped_release release;
+        status = GetApi()->RunWithBinding(
+            _ptr, runOptionsOpt.has_value() ? runOptionsOpt.value().get() : nullptr, binding);
+    }
+    status.Check();
+}
+
+Ortpy::PreparedRun Ortpy::Session::Prepare(
+    const std::vector<std::string>& inputNames,
+    const std::optional<std::vector<std::string>>& outputNames,
+    const std::optional<std::reference_wrapper<Ortpy::RunOptions>>& runOptions,
+    ArrayFramework outputFramework) const
+{
+    return PreparedRun{ *this, inputNames, outputNames, runOptions, outputFramework };
+}
+
+/** PrepackedWeightsContainer */
+
+void Ortpy::PrepackedWeightsContainer::ReleaseOrtType(OrtPrepackedWeightsContainer* ptr)
+{
+    GetApi()->ReleasePrepackedWeightsContainer(ptr);
+}
+
+Ortpy::PrepackedWeightsContainer::PrepackedWeightsContainer()
+    : OrtTypeWrapper<OrtPrepackedWeightsContainer, PrepackedWeightsContainer>(nullptr)
+{
+    Ortpy::Status status = GetApi()->CreatePrepackedWeightsContainer(&_ptr);
+    status.Check();
+}
+
+/** SessionPool */
+
+void Ortpy::SessionPool::CheckSize(size_t size)
+{
+    if (size == 0 || size > MaxSize)
+    {
+        throw std::invalid_argument("size must be between 1 and " + std::to_string(MaxSize));
+    }
+}
+
+Ortpy::SessionPool::SessionPool(const std::string& modelPath, const SessionOptions& options, size_t size)
+    : SessionPool(modelPath, options, size, false)
+{
+}
+
+Ortpy::SessionPool::SessionPool(const std::string& modelPath, const SessionOptions& options, size_t size,
+    bool memoryMap)
+{
+    CheckSize(size);
+    std::string path = ResolveCompiledModelPath(modelPath, options);
+    std::shared_ptr<const MappedFile> mappedModel = memoryMap ? std::make_shared<const MappedFile>(path) : nullptr;
+    _sessions.reserve(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        if (mappedModel)
+        {
+            _sessions.push_back(std::make_unique<Session>(mappedModel, options, _container));
+        }
+        else
+        {
+            _sessions.push_back(std::make_unique<Session>(path, options, _container));
+        }
+    }
+    _idle.store(size == MaxSize ? ~uint64_t{ 0 } : (uint64_t{ 1 } << size) - 1);
+}
+
+Ortpy::SessionPool::SessionPool(const nanobind::object& modelBytes, const SessionOptions& options, size_t size)
+{
+    CheckSize(size);
+    auto compiledPath = ResolveCompiledModelPath(modelBytes, options);
+    _sessions.reserve(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        if (compiledPath)
+        {
+            _sessions.push_back(std::make_unique<Session>(*compiledPath, options, _container));
+        }
+        else
+        {
+            _sessions.push_back(std::make_unique<Session>(modelBytes, options, _container));
+        }
+    }
+    _idle.store(size == MaxSize ? ~uint64_t{ 0 } : (uint64_t{ 1 } << size) - 1);
+}
+
+size_t Ortpy::SessionPool::GetSize() const
+{
+    return _sessions.size();
+}
+
+std::unordered_map<std::string, Ortpy::TensorInfo> Ortpy::SessionPool::GetInputInfo() const
+{
+    return _sessions.front()->GetInputInfo();
+}
+
+std::unordered_map<std::string, Ortpy::TensorInfo> Ortpy::SessionPool::GetOutputInfo() const
+{
+    return _sessions.front()->GetOutputInfo();
+}
+
+Ortpy::SessionPool::Lease Ortpy::SessionPool::Checkout()
+{
+    uint64_t idle = _idle.load(std::memory_order_acquire);
+    while (true)
+    {
+        if (idle == 0)
+        {
+            /** All sessions are busy. Wait for a return without blocking other python threads. */
+            nanobind::gil_scoped_release release;
+            _idle.wait(0, std::memory_order_acquire);
+            idle = _idle.load(std::memory_order_acquire);
+            continue;
+        }
+        uint64_t lowest = idle & (~idle + 1);
+        if (_idle.compare_exchange_weak(idle, idle & ~lowest, std::memory_order_acquire, std::memory_order_acquire))
+        {
+            return Lease{ *this, static_cast<size_t>(std::countr_zero(lowest)) };
+        }
+    }
+}
+
+void Ortpy::SessionPool::Return(size_t index)
+{
+    _idle.fetch_or(uint64_t{ 1 } << index, std::memory_order_release);
+    _idle.notify_one();
+}
+
+nanobind::dict Ortpy::SessionPool::Run(
+    const nanobind::dict& inputs,
+    const std::optional<std::vector<std::string>>& outputNames,
+    const std::optional<std::reference_wrapper<Ortpy::RunOptions>>& runOptions,
+    ArrayFramework outputFramework)
+{
+    Lease lease = Checkout();
+    return lease.GetSession().Run(inputs, outputNames, runOptions, outputFramework);
+}
+
+Ortpy::SessionPool::Lease::Lease(SessionPool& pool, size_t index)
+    : _pool(&pool), _index(index)
+{
+}
+
+Ortpy::SessionPool::Lease::~Lease()
+{
+    Release();
+}
+
+Ortpy::SessionPool::Lease::Lease(Lease&& other) noexcept
+    : _pool(other._pool), _index(other._index)
+{
+    other._pool = nullptr;
+}
+
+Ortpy::Session& Ortpy::SessionPool::Lease::GetSession() const
+{
+    if (_pool == nullptr)
+    {
+        throw std::runtime_error("The session was already returned to the pool");
+    }
+    return *_pool->_sessions[_index];
+}
+
+void Ortpy::SessionPool::Lease::Release()
+{
+    if (_pool)
+    {
+        _pool->Return(_index);
+        _pool = nullptr;
+    }
+}
+
+/** BatchingSession */
+
+/** The outputs of one batched run. Shared by the views handed out to the requests. */
+struct Ortpy::BatchingSession::BatchOutputs
+{
+    std::vector<OrtValue*> values;
+    BatchOutputs() = default;
+    BatchOutputs(const BatchOutputs&) = delete;
+    BatchOutputs& operator=(const BatchOutputs&) = delete;
+    ~BatchOutputs()
+    {
+        for (auto value : values)
+        {
+            if (value)
+            {
+                GetApi()->ReleaseValue(value);
+            }
+        }
+    }
+};
+
+struct Ortpy::BatchingSession::Request
+{
+    /** Ordered as the session inputs. Held by the waiting caller. */
+    std::vector<const InputArray*> inputs;
+    int64_t batchSize{ 0 };
+    std::chrono::steady_clock::time_point enqueued;
+    /** Results */
+    std::shared_ptr<BatchOutputs> outputs;
+    int64_t batchOffset{ 0 };
+    int64_t batchTotal{ 0 };
+    std::string error;
+    std::promise<void> done;
+};
+
+/** Requests can only share a batch if everything but the batch axis matches. */
+static bool CanBatchTogether(const std::vector<const Ortpy::InputArray*>& a,
+    const std::vector<const Ortpy::InputArray*>& b, size_t axis)
+{
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i]->dtype() != b[i]->dtype() || a[i]->ndim() != b[i]->ndim())
+        {
+            return false;
+        }
+        for (size_t d = 0; d < a[i]->ndim(); d++)
+        {
+            if (d != axis && a[i]->shape(d) != b[i]->shape(d))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+Ortpy::BatchingSession::BatchingSession(const Session& session, size_t maxBatchSize, double maxWaitMs, size_t batchAxis)
+    : _session(&session),
+      _maxBatchSize(maxBatchSize),
+      _maxWait(static_cast<int64_t>(maxWaitMs * 1000)),
+      _batchAxis(batchAxis)
+{
+    if (maxBatchSize == 0)
+    {
+        throw std::invalid_argument("max_batch_size must be positive");
+    }
+    if (maxWaitMs < 0)
+    {
+        throw std::invalid_argument("max_wait_ms cannot be negative");
+    }
+    /** The batch dimension is the symbolic dimension every input has on the batch axis. */
+    auto inputInfo = session.GetInputInfo();
+    std::optional<std::string> batchDimension;
+    for (const auto& name : session.GetInputNames())
+    {
+        const auto& info = inputInfo.at(name);
+        if (info.shape.size() <= batchAxis || info.shape[batchAxis] >= 0)
+        {
+            throw std::invalid_argument("Input " + name + " has no symbolic dimension on batch axis " +
+                std::to_string(batchAxis));
+        }
+        if (!batchDimension.has_value())
+        {
+            batchDimension = info.dimensions[batchAxis];
+        }
+        else if (*batchDimension != info.dimensions[batchAxis])
+        {
+            throw std::invalid_argument("Inputs disagree on the symbolic dimension on batch axis " +
+                std::to_string(batchAxis));
+        }
+    }
+    /** Outputs that do not share it, even if their size happens to match, are handed out as a whole. */
+    auto outputInfo = session.GetOutputInfo();
+    for (const auto& name : session.GetOutputNames())
+    {
+        const auto& info = outputInfo.at(name);
+        _isOutputBatched.push_back(batchDimension.has_value() && info.shape.size() > batchAxis &&
+            info.shape[batchAxis] < 0 && info.dimensions[batchAxis] == *batchDimension);
+    }
+    _worker = std::thread([this]() { Worker(); });
+}
+
+Ortpy::BatchingSession::~BatchingSession()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _cv.notify_all();
+    /** The worker never takes the GIL, so it's safe to join while holding it. */
+    _worker.join();
+}
+
+template <typename... Framework>
+static nanobind::object MakeBatchView(void* data, const std::vector<size_t>& shape, nanobind::handle owner,
+    nanobind::dlpack::dtype dtype)
+{
+    return nanobind::cast(nanobind::ndarray<Framework..., nanobind::device::cpu, nanobind::c_contig>(
+        data, shape.size(), shape.data(), owner, nullptr, dtype));
+}
+
+nanobind::dict Ortpy::BatchingSession::Run(
+    const std::unordered_map<std::string, InputArray>& inputs, ArrayFramework outputFramework)
+{
+    const auto& inputNames = _session->GetInputNames();
+    Request request{};
+    request.inputs.reserve(inputNames.size());
+    for (const auto& name : inputNames)
+    {
+        auto it = inputs.find(name);
+        if (it == inputs.end())
+        {
+            throw std::invalid_argument("Missing input: " + name);
+        }
+        if (it->second.ndim() <= _batchAxis)
+        {
+            throw std::invalid_argument("Input " + name + " has no batch axis " + std::to_string(_batchAxis));
+        }
+        int64_t batchSize = it->second.shape(_batchAxis);
+        if (request.inputs.empty())
+        {
+            request.batchSize = batchSize;
+        }
+        else if (batchSize != request.batchSize)
+        {
+            throw std::invalid_argument("Inputs disagree on the batch size");
+        }
+        request.inputs.push_back(&it->second);
+    }
+    auto done = request.done.get_future();
+    {
+        /** Queue and wait for the batch without blocking other python threads. */
+        nanobind::gil_scoped_release release;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            request.enqueued = std::chrono::steady_clock::now();
+            _queue.push_back(&request);
+            _queuedBatchSize += static_cast<size_t>(request.batchSize);
+        }
+        _cv.notify_all();
+        done.wait();
+    }
+    if (!request.error.empty())
+    {
+        throw std::runtime_error(request.error);
+    }
+    /** Split the outputs back. This needs the GIL to create the arrays. */
+    nanobind::dict outputs;
+    const auto& outputNames = _session->GetOutputNames();
+    for (size_t i = 0; i < outputNames.size(); i++)
+    {
+        nanobind::str key(outputNames[i].c_str(), outputNames[i].size());
+        OrtValue* batchValue = request.outputs->values[i];
+        OrtTensorTypeAndShapeInfo* infoRaw = nullptr;
+        Ortpy::Status status = GetApi()->GetTensorTypeAndShape(batchValue, &infoRaw);
+        status.Check();
+        TensorTypeAndShapeInfo info{ infoRaw };
+        ONNXTensorElementDataType ortType;
+        status = GetApi()->GetTensorElementType(info, &ortType);
+        status.Check();
+        if (Value::IsPackedType(ortType))
+        {
+            throw std::runtime_error("Outputs of packed types cannot be split by the batching session");
+        }
+        size_t dimCount = 0;
+        status = GetApi()->GetDimensionsCount(info, &dimCount);
+        status.Check();
+        std::vector<int64_t> shape(dimCount);
+        status = GetApi()->GetDimensions(info, shape.data(), dimCount);
+        status.Check();
+        void* data = nullptr;
+        status = GetApi()->GetTensorMutableData(batchValue, &data);
+        status.Check();
+        /** Outputs that do not follow the batch are shared by every request as a whole. */
+        bool isBatched = _isOutputBatched[i];
+        size_t elementSize = Value::GetSizeOfOrtType(ortType);
+        size_t outer = 1;
+        size_t inner = elementSize;
+        for (size_t d = 0; isBatched && d < dimCount; d++)
+        {
+            if (d < _batchAxis)
+            {
+                outer *= static_cast<size_t>(shape[d]);
+            }
+            else if (d > _batchAxis)
+            {
+                inner *= static_cast<size_t>(shape[d]);
+            }
+        }
+        if (isBatched)
+        {
+            shape[_batchAxis] = request.batchSize;
+        }
+        if (outer == 1)
+        {
+            /** The slice is contiguous. Hand out a view that shares the batch outputs. */
+            std::vector<size_t> npShape(shape.begin(), shape.end());
+            size_t offset = isBatched ? static_cast<size_t>(request.batchOffset) * inner : 0;
+            auto sharedOutputsHeldByNpArray = new std::shared_ptr<BatchOutputs>(request.outputs);
+            nanobind::capsule owner(sharedOutputsHeldByNpArray, [](void* p) noexcept {
+                delete static_cast<std::shared_ptr<BatchOutputs>*>(p);
+            });
+            void* sliceData = static_cast<uint8_t*>(data) + offset;
+            auto dtype = Value::OrtTypeToNpType(ortType);
+            switch (outputFramework)
+            {
+                case ArrayFramework::Numpy:
+                    outputs[key] = MakeBatchView<nanobind::numpy>(sliceData, npShape, owner, dtype);
+                    break;
+                case ArrayFramework::PyTorch:
+                    outputs[key] = MakeBatchView<nanobind::pytorch>(sliceData, npShape, owner, dtype);
+                    break;
+                case ArrayFramework::Jax:
+                    outputs[key] = MakeBatchView<nanobind::jax>(sliceData, npShape, owner, dtype);
+                    break;
+                case ArrayFramework::DLPack:
+                    outputs[key] = MakeBatchView<>(sliceData, npShape, owner, dtype);
+                    break;
+            }
+        }
+        else
+        {
+            /** The slice is strided. Copy it out. */
+            Value slice{ shape, ortType };
+            size_t sliceRow = static_cast<size_t>(request.batchSize) * inner;
+            size_t batchRow = static_cast<size_t>(request.batchTotal) * inner;
+            size_t offset = static_cast<size_t>(request.batchOffset) * inner;
+            auto src = static_cast<const uint8_t*>(data);
+            auto dst = static_cast<uint8_t*>(slice.GetData());
+            for (size_t o = 0; o < outer; o++)
+            {
+                std::memcpy(dst + o * sliceRow, src + o * batchRow + offset, sliceRow);
+            }
+            outputs[key] = slice.ToPython(outputFramework);
+        }
+    }
+    return outputs;
+}
+
+void Ortpy::BatchingSession::Worker()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _cv.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+        if (_queue.empty())
+        {
+            return;
+        }
+        /** Wait for more requests until the batch is full or the oldest one waited long enough. */
+        auto deadline = _queue.front()->enqueued + _maxWait;
+        _cv.wait_until(lock, deadline, [this]() { return _stopping || _queuedBatchSize >= _maxBatchSize; });
+        auto batch = TakeBatch();
+        lock.unlock();
+        RunBatch(batch);
+        lock.lock();
+    }
+}
+
+std::vector<Ortpy::BatchingSession::Request*> Ortpy::BatchingSession::TakeBatch()
+{
+    /** Called with the lock held. The oldest request is always taken. */
+    std::vector<Request*> batch;
+    size_t batchSize = 0;
+    for (auto it = _queue.begin(); it != _queue.end();)
+    {
+        Request* request = *it;
+        bool fits = batch.empty() ||
+            (batchSize + static_cast<size_t>(request->batchSize) <= _maxBatchSize &&
+             CanBatchTogether(batch.front()->inputs, request->inputs, _batchAxis));
+        if (!fits)
+        {
+            ++it;
+            continue;
+        }
+        batch.push_back(request);
+        batchSize += static_cast<size_t>(request->batchSize);
+        _queuedBatchSize -= static_cast<size_t>(request->batchSize);
+        it = _queue.erase(it);
+        if (batchSize >= _maxBatchSize)
+        {
+            break;
+        }
+    }
+    return batch;
+}
+
+void Ortpy::BatchingSession::RunBatch(const std::vector<Request*>& batch)
+{
+    /** This runs on the worker thread without the GIL. Only touch the raw data. */
+    auto outputs = std::make_shared<BatchOutputs>();
+    std::string error;
+    try
+    {
+        int64_t batchTotal = 0;
+        for (auto request : batch)
+        {
+            batchTotal += request->batchSize;
+        }
+        const auto& inputNames = _session->GetInputNames();
+        std::vector<const char*> inputNamesView;
+        inputNamesView.reserve(inputNames.size());
+        std::vector<TensorView> inputValues;
+        inputValues.reserve(inputNames.size());
+        std::vector<OrtValue*> inputValuesView;
+        inputValuesView.reserve(inputNames.size());
+        for (size_t i = 0; i < inputNames.size(); i++)
+        {
+            inputNamesView.push_back(inputNames[i].c_str());
+            const InputArray& first = *batch.front()->inputs[i];
+            if (batch.size() == 1)
+            {
+                /** Nothing to concatenate. Run on the caller's array directly. */
+                inputValues.emplace_back(first, _session->GetScratchArena());
+                inputValuesView.push_back(inputValues.back());
+                continue;
+            }
+            std::vector<int64_t> shape(first.shape_ptr(), first.shape_ptr() + first.ndim());
+            shape[_batchAxis] = batchTotal;
+            OrtValue* valueRaw = nullptr;
+            Ortpy::Status status = GetApi()->CreateTensorAsOrtValue(
+                GetAllocator(), shape.data(), shape.size(), Value::NpTypeToOrtType(first.dtype()), &valueRaw);
+            status.Check();
+            TensorView value{ valueRaw };
+            void* data = nullptr;
+            status = GetApi()->GetTensorMutableData(value, &data);
+            status.Check();
+            /** Copy each request into its slice along the batch axis. The requests may be strided. */
+            auto dstStrides = GetDenseByteStrides(shape.data(), shape.size(), first.itemsize());
+            auto dst = static_cast<uint8_t*>(data);
+            for (auto request : batch)
+            {
+                const InputArray& array = *request->inputs[i];
+                auto srcStrides = GetByteStrides(array);
+                CopyStrided(dst, dstStrides.data(), array.data(), srcStrides.data(),
+                    array.shape_ptr(), array.ndim(), array.itemsize());
+                dst += request->batchSize * dstStrides[_batchAxis];
+            }
+            inputValues.push_back(std::move(value));
+            inputValuesView.push_back(inputValues.back());
+        }
+        const auto& outputNames = _session->GetOutputNames();
+        std::vector<const char*> outputNamesView;
+        outputNamesView.reserve(outputNames.size());
+        for (const auto& name : outputNames)
+        {
+            outputNamesView.push_back(name.c_str());
+        }
+        outputs->values.resize(outputNames.size(), nullptr);
+        Ortpy::Status status = GetApi()->Run(
+            *_session, nullptr,
+            inputNamesView.data(), inputValuesView.data(), inputValuesView.size(),
+            outputNamesView.data(), outputNamesView.size(), outputs->values.data());
+        status.Check();
+        int64_t batchOffset = 0;
+        for (auto request : batch)
+        {
+            request->outputs = outputs;
+            request->batchOffset = batchOffset;
+            request->batchTotal = batchTotal;
+            batchOffset += request->batchSize;
+        }
+    }
+    catch (const std::exception& ex)
+    {
+        error = ex.what();
+    }
+    for (auto request : batch)
+    {
+        if (!error.empty())
+        {
+            request->error = error;
+        }
+        request->done.set_value();
+    }
+}
+
+/** ShapeBucketedSession */
+
+Ortpy::ShapeBucketedSession::ShapeBucketedSession(const std::string& modelPath, const SessionOptions& options,
+    const std::vector<std::string>& dimensionNames, size_t maxSessions, int64_t minBucketSize, bool memoryMap)
+    : _options(&options),
+      _dimensionNames(dimensionNames),
+      _maxSessions(maxSessions),
+      _minBucketSize(minBucketSize)
+{
+    if (dimensionNames.empty())
+    {
+        throw std::invalid_argument("At least one dimension must be bucketed");
+    }
+    if (maxSessions == 0)
+    {
+        throw std::invalid_argument("maxSessions must be positive");
+    }
+    if (minBucketSize <= 0)
+    {
+        throw std::invalid_argument("minBucketSize must be positive");
+    }
+    _modelPath = ResolveCompiledModelPath(modelPath, options);
+    if (memoryMap)
+    {
+        _mappedModel = std::make_shared<const MappedFile>(_modelPath);
+    }
+    {
+        /** Only the specialized sessions run. This one reports the symbolic dimensions. */
+        auto session = _mappedModel ?
+            Session(_mappedModel, options, _container) : Session(_modelPath, options, _container);
+        _inputInfos = session.GetInputInfo();
+        _outputInfos = session.GetOutputInfo();
+    }
+    _inputAxes = FindBucketedAxes(_inputInfos, dimensionNames);
+    _outputAxes = FindBucketedAxes(_outputInfos, dimensionNames);
+    for (size_t d = 0; d < dimensionNames.size(); d++)
+    {
+        bool found = std::any_of(_inputAxes.begin(), _inputAxes.end(), [&](const auto& pair) {
+            return std::any_of(pair.second.begin(), pair.second.end(),
+                [&](const BucketedAxis& axis) { return axis.dimension == d; });
+        });
+        if (!found)
+        {
+            throw std::invalid_argument("No input has the symbolic dimension " + dimensionNames[d]);
+        }
+    }
+}
+
+Ortpy::ShapeBucketedSession::BucketedAxes Ortpy::ShapeBucketedSession::FindBucketedAxes(
+    const std::unordered_map<std::string, TensorInfo>& infos, const std::vector<std::string>& dimensionNames)
+{
+    BucketedAxes bucketedAxes;
+    for (const auto& [name, info] : infos)
+    {
+        std::vector<BucketedAxis> axes;
+        for (size_t axis = 0; axis < info.dimensions.size(); axis++)
+        {
+            auto it = std::find(dimensionNames.begin(), dimensionNames.end(), info.dimensions[axis]);
+            if (it != dimensionNames.end() && info.shape[axis] <= 0)
+            {
+                axes.push_back({ axis, static_cast<size_t>(it - dimensionNames.begin()) });
+            }
+        }
+        if (!axes.empty())
+        {
+            bucketedAxes.emplace(name, std::move(axes));
+        }
+    }
+    return bucketedAxes;
+}
+
+int64_t Ortpy::ShapeBucketedSession::GetBucketSize(int64_t size, int64_t minBucketSize)
+{
+    return static_cast<int64_t>(std::bit_ceil(static_cast<uint64_t>((std::max)(size, minBucketSize))));
+}
+
+std::unordered_map<std::string, Ortpy::TensorInfo> Ortpy::ShapeBucketedSession::GetInputInfo() const
+{
+    return _inputInfos;
+}
+
+std::unordered_map<std::string, Ortpy::TensorInfo> Ortpy::ShapeBucketedSession::GetOutputInfo() const
+{
+    return _outputInfos;
+}
+
+size_t Ortpy::ShapeBucketedSession::GetNumSessions()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _sessions.size();
+}
+
+uint64_t Ortpy::ShapeBucketedSession::GetPaddedBytes() const
+{
+    return _paddingArena->GetPaddedBytes();
+}
+
+std::shared_ptr<Ortpy::Session> Ortpy::ShapeBucketedSession::GetSession(const std::vector<int64_t>& bucketSizes)
+{
+    auto find = [&]() -> std::shared_ptr<Session> {
+        for (auto it = _sessions.begin(); it != _sessions.end(); ++it)
+        {
+            if (it->first == bucketSizes)
+            {
+                _sessions.splice(_sessions.begin(), _sessions, it);
+                return it->second;
+            }
+        }
+        return nullptr;
+    };
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (auto session = find())
+        {
+            return session;
+        }
+    }
+    std::shared_ptr<Session> created;
+    {
+        /** Other buckets keep running while this one is created. */
+        nanobind::gil_scoped_release release;
+        std::unordered_map<std::string, int64_t> dimensions;
+        for (size_t d = 0; d < _dimensionNames.size(); d++)
+        {
+            dimensions.emplace(_dimensionNames[d], bucketSizes[d]);
+        }
+        SessionOptions specialized = _options->WithFreeDimensionOverrides(dimensions);
+        created = _mappedModel ? std::make_shared<Session>(_mappedModel, specialized, _container) :
+            std::make_shared<Session>(_modelPath, specialized, _container);
+    }
+    /** Evicted sessions are released outside of the lock, or after their last run. */
+    std::vector<std::shared_ptr<Session>> evicted;
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (auto session = find())
+    {
+        /** Another thread created the same bucket meanwhile. */
+        return session;
+    }
+    _sessions.emplace_front(bucketSizes, created);
+    while (_sessions.size() > _maxSessions)
+    {
+        evicted.push_back(std::move(_sessions.back().second));
+        _sessions.pop_back();
+    }
+    return created;
+}
+
+template <typename... Framework>
+static nanobind::object MakeLeadingView(const Ortpy::InputArray& array, const std::vector<size_t>& shape,
+    nanobind::handle owner)
+{
+    return nanobind::cast(nanobind::ndarray<Framework..., nanobind::device::cpu>(
+        array.data(), shape.size(), shape.data(), owner, array.stride_ptr(), array.dtype()));
+}
+
+nanobind::dict Ortpy::ShapeBucketedSession::Run(
+    const std::unordered_map<std::string, SessionInput>& inputs,
+    const std::optional<std::vector<std::string>>& outputNames,
+    const std::optional<std::reference_wrapper<RunOptions>>& runOptions,
+    ArrayFramework outputFramework)
+{
+    /** Find the size of each bucketed dimension. */
+    std::vector<int64_t> sizes(_dimensionNames.size(), -1);
+    for (const auto& [name, input] : inputs)
+    {
+        auto it = _inputAxes.find(name);
+        if (it == _inputAxes.end())
+        {
+            continue;
+        }
+        std::vector<int64_t> shape;
+        if (auto strings = std::get_if<std::reference_wrapper<StringTensor>>(&input))
+        {
+            shape = strings->get().GetShape();
+        }
+        else
+        {
+            const auto& array = std::get<InputArray>(input);
+            shape.assign(array.shape_ptr(), array.shape_ptr() + array.ndim());
+        }
+        for (const auto& [axis, dimension] : it->second)
+        {
+            if (axis >= shape.size())
+            {
+                throw std::invalid_argument("Input " + name + " has no axis " + std::to_string(axis));
+            }
+            int64_t size = shape[axis];
+            if (sizes[dimension] < 0)
+            {
+                sizes[dimension] = size;
+            }
+            else if (sizes[dimension] != size)
+            {
+                throw std::invalid_argument("Inputs disagree on the size of " + _dimensionNames[dimension]);
+            }
+        }
+    }
+    std::vector<int64_t> bucketSizes(sizes.size());
+    for (size_t d = 0; d < sizes.size(); d++)
+    {
+        if (sizes[d] < 0)
+        {
+            throw std::invalid_argument("No input has the symbolic dimension " + _dimensionNames[d]);
+        }
+        bucketSizes[d] = GetBucketSize(sizes[d], _minBucketSize);
+    }
+    auto session = GetSession(bucketSizes);
+    /** Pad the inputs to the buckets. The buffers must outlive the run. */
+    std::vector<ScratchArena::Buffer> paddedBuffers;
+    paddedBuffers.reserve(inputs.size());
+    std::unordered_map<std::string, SessionInput> paddedInputs;
+    for (const auto& [name, input] : inputs)
+    {
+        auto it = _inputAxes.find(name);
+        if (auto strings = std::get_if<std::reference_wrapper<StringTensor>>(&input))
+        {
+            auto shape = strings->get().GetShape();
+            for (size_t i = 0; it != _inputAxes.end() && i < it->second.size(); i++)
+            {
+                const auto& [axis, dimension] = it->second[i];
+                if (shape[axis] != bucketSizes[dimension])
+                {
+                    throw std::invalid_argument("String input " + name + " cannot be padded to " +
+                        _dimensionNames[dimension] + "=" + std::to_string(bucketSizes[dimension]));
+                }
+            }
+            paddedInputs.emplace(name, *strings);
+            continue;
+        }
+        const auto& array = std::get<InputArray>(input);
+        std::vector<size_t> paddedShape(array.shape_ptr(), array.shape_ptr() + array.ndim());
+        bool isPadded = false;
+        for (size_t i = 0; it != _inputAxes.end() && i < it->second.size(); i++)
+        {
+            const auto& [axis, dimension] = it->second[i];
+            if (array.shape(axis) != bucketSizes[dimension])
+            {
+                paddedShape[axis] = static_cast<size_t>(bucketSizes[dimension]);
+                isPadded = true;
+            }
+        }
+        if (!isPadded)
+        {
+            paddedInputs.emplace(name, array);
+            continue;
+        }
+        size_t nbytes = array.itemsize();
+        std::vector<int64_t> paddedShapeSigned(paddedShape.begin(), paddedShape.end());
+        for (auto size : paddedShape)
+        {
+            nbytes *= size;
+        }
+        auto& buffer = paddedBuffers.emplace_back(_paddingArena->AcquirePadding(nbytes));
+        /** The arena does not zero its buffers. The padding must be zeros. */
+        std::memset(buffer.GetData(), 0, nbytes);
+        auto srcStrides = GetByteStrides(array);
+        auto dstStrides = GetDenseByteStrides(paddedShapeSigned.data(), paddedShapeSigned.size(), array.itemsize());
+        CopyStrided(buffer.GetData(), dstStrides.data(), array.data(), srcStrides.data(),
+            array.shape_ptr(), array.ndim(), array.itemsize());
+        paddedInputs.emplace(name, InputArray(
+            buffer.GetData(), paddedShape.size(), paddedShape.data(), nanobind::handle(), nullptr, array.dtype()));
+    }
+    nanobind::dict outputs = session->Run(paddedInputs, outputNames, runOptions, outputFramework);
+    /** Slice the outputs back, without copying. The views keep the padded outputs alive. */
+    for (auto [key, output] : outputs)
+    {
+        auto it = _outputAxes.find(nanobind::cast<std::string>(key));
+        if (it == _outputAxes.end())
+        {
+            continue;
+        }
+        /** Strings and other values that are not arrays are returned as they are. */
+        InputArray array;
+        if (!nanobind::try_cast(output, array))
+        {
+            continue;
+        }
+        std::vector<size_t> shape(array.shape_ptr(), array.shape_ptr() + array.ndim());
+        bool isSliced = false;
+        for (const auto& [axis, dimension] : it->second)
+        {
+            /** Skip outputs whose shape does not follow the bucket. */
+            if (axis < shape.size() && array.shape(axis) == bucketSizes[dimension] &&
+                sizes[dimension] != bucketSizes[dimension])
+            {
+                shape[axis] = static_cast<size_t>(sizes[dimension]);
+                isSliced = true;
+            }
+        }
+        if (!isSliced)
+        {
+            continue;
+        }
+        switch (outputFramework)
+        {
+            case ArrayFramework::Numpy:
+                outputs[key] = MakeLeadingView<nanobind::numpy>(array, shape, output);
+                break;
+            case ArrayFramework::PyTorch:
+                outputs[key] = MakeLeadingView<nanobind::pytorch>(array, shape, output);
+                break;
+            case ArrayFramework::Jax:
+                outputs[key] = MakeLeadingView<nanobind::jax>(array, shape, output);
+                break;
+            case ArrayFramework::DLPack:
+                outputs[key] = MakeLeadingView<>(array, shape, output);
+                break;
+        }
+    }
+    return outputs;
+}
+
+/** PreparedRun */
+
+Ortpy::PreparedRun::PreparedRun(
+    const Session& session,
+    const std::vector<std::string>& inputNames,
+    const std::optional<std::vector<std::string>>& outputNamesOpt,
+    const std::optional<std::reference_wrapper<RunOptions>>& runOptionsOpt,
+    ArrayFramework outputFramework)
+    : _session(&session),
+      _runOptions(runOptionsOpt.has_value() ? &runOptionsOpt.value().get() : nullptr),
+      _outputFramework(outputFramework),
+      _inputNames(inputNames),
+      _outputNames(outputNamesOpt.has_value() ? outputNamesOpt.value() : session._outputNames)
+{
+    _inputInfos.reserve(_inputNames.size());
+    for (const auto& name : _inputNames)
+    {
+        auto it = std::find(session._inputNames.begin(), session._inputNames.end(), name);
+        if (it == session._inputNames.end())
+        {
+            throw std::invalid_argument("Unknown input name: " + name);
+        }
+        _inputInfos.push_back(session._inputInfos[it - session._inputNames.begin()]);
+    }
+    for (const auto& name : _outputNames)
+    {
+        if (std::find(session._outputNames.begin(), session._outputNames.end(), name) == session._outputNames.end())
+        {
+            throw std::invalid_argument("Unknown output name: " + name);
+        }
+    }
+    _inputNamesView.reserve(_inputNames.size());
+    for (const auto& name : _inputNames)
+    {
+        _inputNamesView.push_back(name.c_str());
+    }
+    _outputNamesView.reserve(_outputNames.size());
+    for (const auto& name : _outputNames)
+    {
+        _outputNamesView.push_back(name.c_str());
+    }
+}
+
+nanobind::tuple Ortpy::PreparedRun::operator()(const nanobind::args& inputs) const
+{
+    if (inputs.size() != _inputNames.size())
+    {
+        throw std::invalid_argument(
+            "Expected " + std::to_string(_inputNames.size()) + " inputs, got " + std::to_string(inputs.size()));
+    }
+    RunMetrics::Stopwatch stopwatch{ _session->GetRunMetrics() };
+    /** Create input values. The arrays may be converted copies, so hold them during the run. */
+    std::vector<InputArray> arrays;
+    arrays.reserve(_inputNames.size());
+    std::vector<TensorView> inputValues;
+    inputValues.reserve(_inputNames.size());
+    std::vector<OrtValue*> inputValuesView;
+    inputValuesView.reserve(_inputNames.size());
+    for (size_t i = 0; i < _inputNames.size(); i++)
+    {
+        const InputArray& array = arrays.emplace_back(nanobind::cast<InputArray>(inputs[i]));
+        const auto& info = _inputInfos[i];
+        /** An empty info means a non-tensor input. Leave the checks to ort. */
+        if (info.dtype.bits != 0)
+        {
+            if (array.dtype() != info.dtype && Value::NpTypeToOrtType(array.dtype()) != info.type)
+            {
+                throw std::invalid_argument("Input " + _inputNames[i] + " expects dtype " + Value::NpTypeToName(info.dtype));
+            }
+            if (array.ndim() != info.shape.size())
+            {
+                throw std::invalid_argument(
+                    "Input " + _inputNames[i] + " expects rank " + std::to_string(info.shape.size()));
+            }
+        }
+        inputValues.emplace_back(array, _session->GetScratchArena(), info.type);
+        inputValuesView.push_back(inputValues.back());
+        stopwatch.Add(RunMetrics::BytesIn, array.nbytes());
+    }
+    /** Let ort allocate the output values as we may not known their shapes */
+    std::vector<OrtValue*> outputValues(_outputNamesView.size(), nullptr);
+    stopwatch.Lap(RunMetrics::InputNs);
+    Ortpy::Status status{ nullptr };
+    {
+        nanobind::gil_scoped_release release;
+        status = GetApi()->Run(
+            *_session, _runOptions ? static_cast<OrtRunOptions*>(*_runOptions) : nullptr,
+            _inputNamesView.data(), inputValuesView.data(), inputValuesView.size(),
+            _outputNamesView.data(), _outputNamesView.size(), outputValues.data());
+    }
+    stopwatch.Lap(RunMetrics::RunNs);
+    std::vector<Value> outputValuesWrapper;
+    outputValuesWrapper.reserve(outputValues.size());
+    for (auto value : outputValues)
+    {
+        /** safe guard the raw values first. */
+        outputValuesWrapper.emplace_back(value);
+    }
+    status.Check();
+    nanobind::tuple outputs = nanobind::steal<nanobind::tuple>(PyTuple_New(outputValuesWrapper.size()));
+    for (size_t i = 0; i < outputValuesWrapper.size(); i++)
+    {
+        PyTuple_SET_ITEM(outputs.ptr(), i, outputValuesWrapper[i].ToPython(_outputFramework).release().ptr());
+    }
+    if (stopwatch.IsEnabled())
+    {
+        for (const auto& value : outputValuesWrapper)
+        {
+            stopwatch.Add(RunMetrics::BytesOut, value.GetSize());
+        }
+    }
+    stopwatch.Lap(RunMetrics::OutputNs);
+    return outputs;
+}
+
+const std::vector<std::string>& Ortpy::PreparedRun::GetInputNames() const
+{
+    return _inputNames;
+}
+
+const std::vector<std::string>& Ortpy::PreparedRun::GetOutputNames() const
+{
+    return _outputNames;
+}
+
+/** Value */
+
+Ortpy::Value::State::~State()
+{
+    if (ortValue != nullptr)
+    {
+        GetApi()->ReleaseValue(ortValue);
+    }
+}
+
+template <typename... Framework>
+nanobind::ndarray<Framework..., nanobind::device::cpu, nanobind::c_contig> Ortpy::Value::MakeArray() const
+{
+    auto type = GetType();
+    if (IsPackedType(type))
+    {
+        throw std::runtime_error("A tensor of packed type " + OrtTypeToName(type) + " cannot be viewed as an array");
+    }
+    auto npType = OrtTypeToNpType(type);
+    auto ortShape = GetShape();
+    std::vector<size_t> npShape(ortShape.begin(), ortShape.end());
+    auto sharedStateHeldByNpArray = new std::shared_ptr<State>(_state);
+    nanobind::capsule owner(sharedStateHeldByNpArray, [](void* p) noexcept {
+        delete static_cast<std::shared_ptr<State>*>(p);
+    });
+    return nanobind::ndarray<Framework..., nanobind::device::cpu, nanobind::c_contig>(
+        GetData(),
+        npShape.size(),
+        npShape.data(),
+        owner,
+        nullptr,
+        npType);
+}
+
+Ortpy::Value::Value(OrtValue* ptr)
+{
+    if (ptr == nullptr)
+    {
+        /** Create an empty value */
+        return;
+    }
+    _state->ortValue = ptr;
+    if (!HasValue() || GetOnnxType() != ONNX_TYPE_TENSOR)
+    {
+        /** Sequences, maps and missing optional values are wrapped by ToPython. */
+        return;
+    }
+    auto type = GetType();
+    if (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING)
+    {
+        /** Strings are not viewed as an array. See StringTensor. */
+        return;
+    }
+    if (IsPackedType(type))
+    {
+        /** numpy has no 4 bit types. Unpack to a byte per element. */
+        bool isSigned = type == ONNX_TENSOR_ELEMENT_DATA_TYPE_INT4;
+        Value unpacked{ GetShape(), isSigned ? ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8 : ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8 };
+        size_t count = unpacked.GetSize();
+        if (count > 0)
+        {
+            UnpackInt4(static_cast<const uint8_t*>(GetData()), static_cast<uint8_t*>(unpacked.GetData()),
+                count, isSigned);
+        }
+        *this = unpacked;
+    }
+    /** The array is made by ToPython, for the framework requested. */
+}
+
+Ortpy::Value::Value(const InputArray& array, ONNXTensorElementDataType expectedType, ScratchArena* scratchArena)
+{
+    auto type = GetTensorType(array, expectedType);
+    if (scratchArena)
+    {
+        _state->ortValue = CreateTensorInArena(array, type, *scratchArena, _state->repacked);
+        if (_state->repacked.GetData() == nullptr)
+        {
+            /** Used in place. The Value holds a reference to keep it alive. */
+            _state->npArray = NpArray(array);
+        }
+        return;
+    }
+    if (IsPackedType(type))
+    {
+        /** A byte per element in the array. Pack two per byte into a tensor owned by the value. */
+        std::vector<int64_t> shape(array.shape_ptr(), array.shape_ptr() + array.ndim());
+        *this = Value{ shape, type };
+        std::vector<uint8_t> dense;
+        auto src = static_cast<const uint8_t*>(array.data());
+        if (!IsCContiguous(array))
+        {
+            dense.resize(array.nbytes());
+            RepackArray(array, dense.data());
+            src = dense.data();
+        }
+        PackInt4(src, static_cast<uint8_t*>(GetData()), array.size());
+        return;
+    }
+    if (!IsCContiguous(array))
+    {
+        /** ort only takes dense tensors. Repack into a tensor owned by the value. */
+        std::vector<int64_t> shape(array.shape_ptr(), array.shape_ptr() + array.ndim());
+        *this = Value{ shape, type };
+        RepackArray(array, GetData());
+        return;
+    }
+    /** array holds the data, the Value holds a reference to keep it alive. */
+    _state->npArray = NpArray(array);
+    _state->ortValue = CreateTensorFromArray(array, nullptr, type);
+}
+
+Ortpy::Value::Value(const std::vector<int64_t>& ortShape, ONNXTensorElementDataType ortType)
+{
+    Ortpy::Status status = GetApi()->CreateTensorAsOrtValue(
+        GetAllocator(),
+        ortShape.data(),
+        ortShape.size(),
+        ortType,
+        &_state->ortValue);
+    status.Check();
+}
+
+/** Strings, sequences, maps and missing optional values are not viewed as an array. */
+static bool IsArrayValue(const Ortpy::Value& value)
+{
+    return static_cast<OrtValue*>(value) != nullptr && value.HasValue() &&
+        value.GetOnnxType() == ONNX_TYPE_TENSOR && value.GetType() != ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING;
+}
+
+Ortpy::Value::operator Ortpy::NpArray() const
+{
+    if (_state->npArray.has_value())
+    {
+        return *(_state->npArray);
+    }
+    if (!IsArrayValue(*this))
+    {
+        throw std::runtime_error("Value does not hold a numpy array");
+    }
+    /** Not stored in the state, as the array holds the state. */
+    return MakeArray<nanobind::numpy>();
+}
+
+/** A map's keys or values as a python list. */
+static nanobind::list ToList(const Ortpy::Value& value)
+{
+    if (value.GetType() == ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING)
+    {
+        return nanobind::list(Ortpy::StringTensor(value).ToNumpy().attr("tolist")());
+    }
+    return nanobind::list(value.ToPython(Ortpy::ArrayFramework::Numpy).attr("tolist")());
+}
+
+nanobind::object Ortpy::Value::ToPython(ArrayFramework framework) const
+{
+    /** Everything but a numeric tensor. */
+    if (!_state->npArray.has_value() && !IsArrayValue(*this))
+    {
+        if (_state->ortValue == nullptr || !HasValue())
+        {
+            return nanobind::none();
+        }
+        auto onnxType = GetOnnxType();
+        switch (onnxType)
+        {
+            case ONNX_TYPE_TENSOR:
+                if (GetType() == ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING)
+                {
+                    return nanobind::cast(StringTensor(*this));
+                }
+                break;
+            case ONNX_TYPE_SEQUENCE:
+            {
+                nanobind::list items;
+                size_t count = GetElementCount();
+                for (size_t i = 0; i < count; i++)
+                {
+                    items.append(GetElement(i).ToPython(framework));
+                }
+                return items;
+            }
+            case ONNX_TYPE_MAP:
+            {
+                /** Maps hold scalars, e.g. the class probabilities of ZipMap. */
+                nanobind::list keys = ToList(GetElement(0));
+                nanobind::list values = ToList(GetElement(1));
+                nanobind::dict map;
+                for (size_t i = 0; i < keys.size(); i++)
+                {
+                    map[keys[i]] = values[i];
+                }
+                return map;
+            }
+            default:
+                break;
+        }
+        throw std::runtime_error("Unsupported ONNX value type: " + std::to_string(onnxType));
+    }
+    switch (framework)
+    {
+        case ArrayFramework::Numpy:
+            return nanobind::cast(NpArray(*this));
+        case ArrayFramework::PyTorch:
+            return nanobind::cast(MakeArray<nanobind::pytorch>());
+        case ArrayFramework::Jax:
+            return nanobind::cast(MakeArray<nanobind::jax>());
+        case ArrayFramework::DLPack:
+            return nanobind::cast(MakeArray<>());
+    }
+    throw std::runtime_error("Unsupported array framework");
+}
+
+Ortpy::Value::operator OrtValue*() const
+{
+    return _state->ortValue;
+}
+
+bool Ortpy::Value::HasValue() const
+{
+    if (_state->ortValue == nullptr)
+    {
+        throw std::runtime_error("Value is empty");
+    }
+    int hasValue = 0;
+    Ortpy::Status status = GetApi()->HasValue(_state->ortValue, &hasValue);
+    status.Check();
+    return hasValue != 0;
+}
+
+ONNXType Ortpy::Value::GetOnnxType() const
+{
+    if (_state->ortValue == nullptr)
+    {
+        throw std::runtime_error("Value is empty");
+    }
+    ONNXType type = ONNX_TYPE_UNKNOWN;
+    Ortpy::Status status = GetApi()->GetValueType(_state->ortValue, &type);
+    status.Check();
+    return type;
+}
+
+size_t Ortpy::Value::GetElementCount() const
+{
+    if (_state->ortValue == nullptr)
+    {
+        throw std::runtime_error("Value is empty");
+    }
+    size_t count = 0;
+    Ortpy::Status status = GetApi()->GetValueCount(_state->ortValue, &count);
+    status.Check();
+    return count;
+}
+
+Ortpy::Value Ortpy::Value::GetElement(size_t index) const
+{
+    if (_state->ortValue == nullptr)
+    {
+        throw std::runtime_error("Value is empty");
+    }
+    OrtValue* element = nullptr;
+    Ortpy::Status status = GetApi()->GetValue(_state->ortValue, static_cast<int>(index), GetAllocator(), &element);
+    status.Check();
+    return Value{ element };
+}
+
+ONNXTensorElementDataType Ortpy::Value::GetType() const
+{
+    if (_state->ortValue == nullptr)
+    {
+        throw std::runtime_error("Value is empty");
+    }
+    OrtTensorTypeAndShapeInfo *infoRaw = nullptr;
+    Ortpy::Status status = GetApi()->GetTensorTypeAndShape(_state->ortValue, &infoRaw);
+    status.Check();
+    TensorTypeAndShapeInfo info{ infoRaw };
+    ONNXTensorElementDataType type;
+    status = GetApi()->GetTensorElementType(info, &type);
+    status.Check();
+    return type;
+}
+
+std::vector<int64_t> Ortpy::Value::GetShape() const
+{
+    if (_state->ortValue == nullptr)
+    {
+        throw std::runtime_error("Value is empty");
+    }
+    OrtTensorTypeAndShapeInfo *infoRaw = nullptr;
+    Ortpy::Status status = GetApi()->GetTensorTypeAndShape(_state->ortValue, &infoRaw);
+    status.Check();
+    TensorTypeAndShapeInfo info{ infoRaw };
+    size_t dimCount = 0;
+    status = GetApi()->GetDimensionsCount(info, &dimCount);
+    status.Check();
+    std::vector<int64_t> shape(dimCount);
+    status = GetApi()->GetDimensions(info, shape.data(), dimCount);
+    status.Check();
+    return shape;
+}
+
+size_t Ortpy::Value::GetSize() const
+{
+    if (_state->ortValue == nullptr)
+    {
+        throw std::runtime_error("Value is empty");
+    }
+    if (!HasValue() || GetOnnxType() != ONNX_TYPE_TENSOR)
+    {
+        /** Only tensors are counted. */
+        return 0;
+    }
+    auto type = GetType();
+    if (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING)
+    {
+        /** The bytes of the content. */
+        size_t length = 0;
+        Ortpy::Status status = GetApi()->GetStringTensorDataLength(_state->ortValue, &length);
+        status.Check();
+        return length;
+    }
+    auto shape = GetShape();
+    size_t count = 1;
+    for (const auto& dim : shape)
+    {
+        if (dim < 0)
+        {
+            throw std::runtime_error("Invalid dimension size: " + std::to_string(dim));
+        }
+        count *= static_cast<size_t>(dim);
+    }
+    if (IsPackedType(type))
+    {
+        return (count + 1) / 2;
+    }
+    return count * GetSizeOfOrtType(type);
+}
+
+void* Ortpy::Value::GetData() const
+{
+    if (_state->ortValue == nullptr)
     {
         throw std::runtime_error("Value is empty");
     }
-    auto shape = GetShape();
-    auto type = GetType();
-    size_t typeSize = 0;
-    switch (type) {
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
-            typeSize = sizeof(float);
-            break;
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
-            typeSize = sizeof(uint8_t);
-            break;
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:
-            typeSize = sizeof(int8_t);
-            break;
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:
-            typeSize = sizeof(uint16_t);
-            break;
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:
-            typeSize = sizeof(int16_t);
-            break;
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
-            typeSize = sizeof(int32_t);
-            break;
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
-            typeSize = sizeof(int64_t);
-            break;
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:
-            typeSize = sizeof(bool);
-            break;
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
-            typeSize = 2; // float16 is 2 bytes
-            break;
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:
-            typeSize = sizeof(double);
-            break;
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32:
-            typeSize = sizeof(uint32_t);
-            break;
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64:
-            typeSize = sizeof(uint64_t);
-            break;
-        default:
-            throw std::runtime_error("Unsupported ONNX tensor element data type: " + std::to_string(type));
+    void* data = nullptr;
+    Ortpy::Status status = GetApi()->GetTensorMutableData(_state->ortValue, &data);
+    if (data == nullptr)
+    {
+        throw std::runtime_error("Failed to get data from OrtValue.");
+    }
+    return data;
+}
+
+/** DLPack 1.1 codes of the float8 types. nanobind does not name them. */
+enum class DLPackFloat8Code : uint8_t
+{
+    E4M3FN = 10,
+    E4M3FNUZ = 11,
+    E5M2 = 12,
+    E5M2FNUZ = 13,
+};
+
+static nanobind::dlpack::dtype GetFloat8DType(DLPackFloat8Code code)
+{
+    return { static_cast<uint8_t>(code), 8, 1 };
+}
+
+ONNXTensorElementDataType Ortpy::Value::NpTypeToOrtType(const nanobind::dlpack::dtype& npType)
+{
+    /** Initialized once, also when first used from several threads. */
+    static const auto typeMap = []() {
+        std::map<nanobind::dlpack::dtype, ONNXTensorElementDataType> typeMap{};
+        typeMap[nanobind::dtype<bool>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL;
+        typeMap[nanobind::dtype<int8_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8;
+        typeMap[nanobind::dtype<uint8_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8;
+        typeMap[nanobind::dtype<int16_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16;
+        typeMap[nanobind::dtype<uint16_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16;
+        typeMap[nanobind::dtype<int32_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32;
+        typeMap[nanobind::dtype<uint32_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32;
+        typeMap[nanobind::dtype<int64_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64;
+        typeMap[nanobind::dtype<uint64_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64;
+        typeMap[nanobind::dtype<float>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+        typeMap[nanobind::dtype<double>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE;
+        typeMap[{ static_cast<uint8_t>(nanobind::dlpack::dtype_code::Float), 16, 1 }] = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16;
+        /** Frameworks with these types, e.g. torch, export them through dlpack. */
+        typeMap[{ static_cast<uint8_t>(nanobind::dlpack::dtype_code::Bfloat), 16, 1 }] = ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16;
+        typeMap[GetFloat8DType(DLPackFloat8Code::E4M3FN)] = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E4M3FN;
+        typeMap[GetFloat8DType(DLPackFloat8Code::E4M3FNUZ)] = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E4M3FNUZ;
+        typeMap[GetFloat8DType(DLPackFloat8Code::E5M2)] = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E5M2;
+        typeMap[GetFloat8DType(DLPackFloat8Code::E5M2FNUZ)] = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E5M2FNUZ;
+        return typeMap;
+    }();
+    auto it = typeMap.find(npType);
+    if (it == typeMap.end())
+    {
+        throw std::runtime_error("Unsupported NumPy data type: " + std::to_string(npType.code) + ", " + std::to_string(npType.bits) + ", " + std::to_string(npType.lanes));
+    }
+    return it->second;
+}
+
+nanobind::dlpack::dtype Ortpy::Value::OrtTypeToNpType(ONNXTensorElementDataType ortType)
+{
+    switch (ortType) {
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+            return nanobind::dtype<float>();
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
+            return nanobind::dtype<uint8_t>();
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:
+            return nanobind::dtype<int8_t>();
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:
+            return nanobind::dtype<uint16_t>();
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:
+            return nanobind::dtype<int16_t>();
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
+            return nanobind::dtype<int32_t>();
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
+            return nanobind::dtype<int64_t>();
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:
+            return nanobind::dtype<bool>();
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+            return { static_cast<uint8_t>(nanobind::dlpack::dtype_code::Float), 16, 1 };
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:
+            return nanobind::dtype<double>();
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32:
+            return nanobind::dtype<uint32_t>();
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64:
+            return nanobind::dtype<uint64_t>();
+        /** Raw views. See IsRawViewType. */
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16:
+            return nanobind::dtype<uint16_t>();
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E4M3FN:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E4M3FNUZ:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E5M2:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E5M2FNUZ:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT4:
+            return nanobind::dtype<uint8_t>();
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT4:
+            return nanobind::dtype<int8_t>();
+        default:
+            break;
+    }
+    throw std::runtime_error("Unsupported ONNX tensor element data type: " + std::to_string(ortType));
+}
+
+std::string Ortpy::Value::NpTypeToName(const nanobind::dlpack::dtype& npType)
+{
+    static const auto typeMap = []() {
+        std::map<nanobind::dlpack::dtype, std::string> typeMap{};
+        typeMap[nanobind::dtype<bool>()] = "bool";
+        typeMap[nanobind::dtype<int8_t>()] = "int8";
+        typeMap[nanobind::dtype<uint8_t>()] = "uint8";
+        typeMap[nanobind::dtype<int16_t>()] = "int16";
+        typeMap[nanobind::dtype<uint16_t>()] = "uint16";
+        typeMap[nanobind::dtype<int32_t>()] = "int32";
+        typeMap[nanobind::dtype<uint32_t>()] = "uint32";
+        typeMap[nanobind::dtype<int64_t>()] = "int64";
+        typeMap[nanobind::dtype<uint64_t>()] = "uint64";
+        typeMap[nanobind::dtype<float>()] = "float32";
+        typeMap[nanobind::dtype<double>()] = "float64";
+        typeMap[{ static_cast<uint8_t>(nanobind::dlpack::dtype_code::Float), 16, 1 }] = "float16";
+        typeMap[{ static_cast<uint8_t>(nanobind::dlpack::dtype_code::Bfloat), 16, 1 }] = "bfloat16";
+        typeMap[GetFloat8DType(DLPackFloat8Code::E4M3FN)] = "float8_e4m3fn";
+        typeMap[GetFloat8DType(DLPackFloat8Code::E4M3FNUZ)] = "float8_e4m3fnuz";
+        typeMap[GetFloat8DType(DLPackFloat8Code::E5M2)] = "float8_e5m2";
+        typeMap[GetFloat8DType(DLPackFloat8Code::E5M2FNUZ)] = "float8_e5m2fnuz";
+        return typeMap;
+    }();
+    auto it = typeMap.find(npType);
+    if (it == typeMap.end())
+    {
+        throw std::runtime_error("Unsupported NumPy data type: " + std::to_string(npType.code) + ", " + std::to_string(npType.bits) + ", " + std::to_string(npType.lanes));
+    }
+    return it->second;
+}
+
+size_t Ortpy::Value::GetSizeOfOrtType(ONNXTensorElementDataType ortType)
+{
+    switch (ortType) {
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+            return sizeof(float);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
+            return sizeof(uint8_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:
+            return sizeof(int8_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:
+            return sizeof(uint16_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:
+            return sizeof(int16_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
+            return sizeof(int32_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
+            return sizeof(int64_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:
+            return sizeof(bool);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+            return 2;
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:
+            return sizeof(double);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32:
+            return sizeof(uint32_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64:
+            return sizeof(uint64_t);
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16:
+            return 2;
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E4M3FN:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E4M3FNUZ:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E5M2:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E5M2FNUZ:
+            return 1;
+        /** The size of an unpacked element. Packed tensors take half a byte per element. */
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT4:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT4:
+            return 1;
+        default:
+            break;
+    }
+    throw std::runtime_error("Unsupported ONNX tensor element data type: " + std::to_string(ortType));
+}
+
+std::string Ortpy::Value::OrtTypeToName(ONNXTensorElementDataType ortType)
+{
+    switch (ortType) {
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16:
+            return "bfloat16";
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E4M3FN:
+            return "float8_e4m3fn";
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E4M3FNUZ:
+            return "float8_e4m3fnuz";
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E5M2:
+            return "float8_e5m2";
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E5M2FNUZ:
+            return "float8_e5m2fnuz";
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT4:
+            return "int4";
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT4:
+            return "uint4";
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING:
+            return "string";
+        default:
+            return NpTypeToName(OrtTypeToNpType(ortType));
+    }
+}
+
+bool Ortpy::Value::IsRawViewType(ONNXTensorElementDataType ortType)
+{
+    switch (ortType) {
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E4M3FN:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E4M3FNUZ:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E5M2:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT8E5M2FNUZ:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT4:
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT4:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool Ortpy::Value::IsPackedType(ONNXTensorElementDataType ortType)
+{
+    return ortType == ONNX_TENSOR_ELEMENT_DATA_TYPE_INT4 || ortType == ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT4;
+}
+
+/** StringTensor */
+
+Ortpy::StringTensor::StringTensor(const Value& value)
+    : _value(value)
+{
+    if (_value.GetType() != ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING)
+    {
+        throw std::invalid_argument("Value is not a string tensor");
+    }
+}
+
+Ortpy::StringTensor::StringTensor(const std::vector<int64_t>& shape)
+    : _value(shape, ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING)
+{
+}
+
+char* Ortpy::StringTensor::GetElementBuffer(size_t index, size_t length)
+{
+    char* buffer = nullptr;
+    Ortpy::Status status = GetApi()->GetResizedStringTensorElementBuffer(_value, index, length, &buffer);
+    status.Check();
+    return buffer;
+}
+
+Ortpy::StringTensor Ortpy::StringTensor::FromArray(const nanobind::object& strings)
+{
+    auto numpy = nanobind::module_::import_("numpy");
+    nanobind::object array = numpy.attr("asarray")(strings);
+    auto kind = nanobind::cast<std::string>(array.attr("dtype").attr("kind"));
+    if (kind == "T")
+    {
+        /** numpy converts StringDType to fixed width unicode natively. */
+        array = array.attr("astype")(numpy.attr("str_"));
+        kind = "U";
+    }
+    StringTensor tensor{ nanobind::cast<std::vector<int64_t>>(array.attr("shape")) };
+    size_t count = tensor.GetCount();
+    if (kind == "S" || kind == "U")
+    {
+        /** Fixed width elements, padded with zeros. Read the buffer directly. */
+        nanobind::object dtype = array.attr("dtype").attr("newbyteorder")("=");
+        array = numpy.attr("ascontiguousarray")(array, dtype);
+        size_t itemSize = nanobind::cast<size_t>(dtype.attr("itemsize"));
+        PyBuffer buffer{ array };
+        auto data = static_cast<const uint8_t*>(buffer.GetData());
+        nanobind::gil_scoped_release release;
+        for (size_t i = 0; i < count; i++)
+        {
+            const uint8_t* item = data + i * itemSize;
+            if (kind == "S")
+            {
+                size_t length = itemSize;
+                while (length > 0 && item[length - 1] == 0)
+                {
+                    length--;
+                }
+                std::memcpy(tensor.GetElementBuffer(i, length), item, length);
+                continue;
+            }
+            size_t codePoints = itemSize / sizeof(uint32_t);
+            auto readCodePoint = [&](size_t j) {
+                uint32_t codePoint;
+                std::memcpy(&codePoint, item + j * sizeof(uint32_t), sizeof(uint32_t));
+                return codePoint;
+            };
+            while (codePoints > 0 && readCodePoint(codePoints - 1) == 0)
+            {
+                codePoints--;
+            }
+            size_t length = 0;
+            for (size_t j = 0; j < codePoints; j++)
+            {
+                uint32_t codePoint = readCodePoint(j);
+                if (codePoint > 0x10ffff)
+                {
+                    throw std::invalid_argument("Invalid code point in element " + std::to_string(i));
+                }
+                length += GetUtf8Length(codePoint);
+            }
+            char* out = tensor.GetElementBuffer(i, length);
+            for (size_t j = 0; j < codePoints; j++)
+            {
+                out = EncodeUtf8(out, readCodePoint(j));
+            }
+        }
+        return tensor;
+    }
+    if (kind != "O")
+    {
+        throw std::invalid_argument("Expected an array of strings, got dtype kind " + kind);
+    }
+    size_t i = 0;
+    for (nanobind::handle item : array.attr("ravel")())
+    {
+        char* data = nullptr;
+        Py_ssize_t length = 0;
+        /** Holds the encoding of a str with lone surrogates. */
+        nanobind::object escaped;
+        if (PyUnicode_Check(item.ptr()))
+        {
+            /**
+             * An ASCII str is its own UTF-8. Any other str is encoded on the first call into a copy
+             *     cached on the str, which then lives as long as the str.
+             */
+            data = const_cast<char*>(PyUnicode_AsUTF8AndSize(item.ptr(), &length));
+            if (data == nullptr)
+            {
+                /** Lone surrogates, e.g. from to_numpy. Encode them back to the bytes they escape. */
+                PyErr_Clear();
+                escaped = nanobind::steal(PyUnicode_AsEncodedString(item.ptr(), "utf-8", "surrogateescape"));
+                if (!escaped.is_valid() || PyBytes_AsStringAndSize(escaped.ptr(), &data, &length) != 0)
+                {
+                    nanobind::raise_python_error();
+                }
+            }
+        }
+        else if (PyBytes_Check(item.ptr()))
+        {
+            if (PyBytes_AsStringAndSize(item.ptr(), &data, &length) != 0)
+            {
+                nanobind::raise_python_error();
+            }
+        }
+        else
+        {
+            throw std::invalid_argument("Elements of a string tensor must be str or bytes");
+        }
+        std::memcpy(tensor.GetElementBuffer(i++, static_cast<size_t>(length)), data, static_cast<size_t>(length));
+    }
+    return tensor;
+}
+
+Ortpy::StringTensor Ortpy::StringTensor::FromBuffer(const nanobind::object& data, const InputArray& offsets,
+    const std::vector<int64_t>& shape)
+{
+    if (offsets.dtype() != nanobind::dtype<int64_t>() || offsets.ndim() != 1)
+    {
+        throw std::invalid_argument("offsets must be a 1-D int64 array");
+    }
+    StringTensor tensor{ shape };
+    size_t count = tensor.GetCount();
+    if (offsets.shape(0) != count + 1)
+    {
+        throw std::invalid_argument(
+            "Expected " + std::to_string(count + 1) + " offsets, got " + std::to_string(offsets.shape(0)));
+    }
+    PyBuffer buffer{ data };
+    auto bytes = static_cast<const char*>(buffer.GetData());
+    auto size = static_cast<int64_t>(buffer.GetSize());
+    auto offsetsData = static_cast<const int64_t*>(offsets.data());
+    int64_t stride = offsets.stride(0);
+    nanobind::gil_scoped_release release;
+    for (size_t i = 0; i < count; i++)
+    {
+        int64_t begin = offsetsData[static_cast<int64_t>(i) * stride];
+        int64_t end = offsetsData[static_cast<int64_t>(i + 1) * stride];
+        if (begin < 0 || end < begin || end > size)
+        {
+            throw std::invalid_argument("Offsets of element " + std::to_string(i) + " are out of the buffer");
+        }
+        size_t length = static_cast<size_t>(end - begin);
+        std::memcpy(tensor.GetElementBuffer(i, length), bytes + begin, length);
+    }
+    return tensor;
+}
+
+std::vector<int64_t> Ortpy::StringTensor::GetShape() const
+{
+    return _value.GetShape();
+}
+
+size_t Ortpy::StringTensor::GetCount() const
+{
+    size_t count = 1;
+    for (auto dim : GetShape())
+    {
+        count *= static_cast<size_t>(dim);
+    }
+    return count;
+}
+
+nanobind::tuple Ortpy::StringTensor::GetContent() const
+{
+    size_t count = GetCount();
+    size_t length = _value.GetSize();
+    /** Filled in place, before python sees it. */
+    nanobind::object content = nanobind::steal(PyBytes_FromStringAndSize(nullptr, static_cast<Py_ssize_t>(length)));
+    if (!content.is_valid())
+    {
+        nanobind::raise_python_error();
+    }
+    std::vector<size_t> starts(count);
+    Ortpy::Status status = GetApi()->GetStringTensorContent(
+        _value, PyBytes_AsString(content.ptr()), length, starts.data(), count);
+    status.Check();
+    Value offsets{ { static_cast<int64_t>(count + 1) }, ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64 };
+    auto offsetsData = static_cast<int64_t*>(offsets.GetData());
+    for (size_t i = 0; i < count; i++)
+    {
+        offsetsData[i] = static_cast<int64_t>(starts[i]);
+    }
+    offsetsData[count] = static_cast<int64_t>(length);
+    return nanobind::make_tuple(content, offsets.ToPython(ArrayFramework::Numpy));
+}
+
+nanobind::object Ortpy::StringTensor::ToNumpy() const
+{
+    size_t count = GetCount();
+    size_t length = _value.GetSize();
+    std::vector<char> content(length + 1);
+    std::vector<size_t> starts(count);
+    Ortpy::Status status = GetApi()->GetStringTensorContent(_value, content.data(), length, starts.data(), count);
+    status.Check();
+    nanobind::list items;
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t end = i + 1 < count ? starts[i + 1] : length;
+        PyObject* item = PyUnicode_DecodeUTF8(
+            content.data() + starts[i], static_cast<Py_ssize_t>(end - starts[i]), "surrogateescape");
+        if (item == nullptr)
+        {
+            nanobind::raise_python_error();
+        }
+        items.append(nanobind::steal(item));
+    }
+    auto numpy = nanobind::module_::import_("numpy");
+    nanobind::object array = numpy.attr("array")(items, nanobind::arg("dtype") = "object");
+    return array.attr("reshape")(nanobind::cast(GetShape()));
+}
+
+const Ortpy::Value& Ortpy::StringTensor::GetValue() const
+{
+    return _value;
+}
+
+/** TensorView */
+
+void Ortpy::TensorView::ReleaseOrtType(OrtValue* ptr)
+{
+    GetApi()->ReleaseValue(ptr);
+}
+
+Ortpy::TensorView::TensorView(const InputArray& array, ScratchArena& scratchArena,
+    ONNXTensorElementDataType expectedType)
+    : OrtTypeWrapper<OrtValue, TensorView>(nullptr)
+{
+    _ptr = CreateTensorInArena(array, GetTensorType(array, expectedType), scratchArena, _repacked);
+}
+
+/** ScratchArena */
+
+Ortpy::ScratchArena::Buffer::Buffer(std::shared_ptr<ScratchArena> arena, Storage&& storage)
+    : _arena(std::move(arena)), _storage(std::move(storage))
+{
+}
+
+Ortpy::ScratchArena::Buffer::~Buffer()
+{
+    if (_arena)
+    {
+        _arena->Release(std::move(_storage));
+    }
+}
+
+Ortpy::ScratchArena::Buffer::Buffer(Buffer&& other) noexcept
+    : _arena(std::move(other._arena)), _storage(std::move(other._storage))
+{
+}
+
+Ortpy::ScratchArena::Buffer& Ortpy::ScratchArena::Buffer::operator=(Buffer&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (_arena)
+        {
+            _arena->Release(std::move(_storage));
+        }
+        _arena = std::move(other._arena);
+        _storage = std::move(other._storage);
+    }
+    return *this;
+}
+
+uint8_t* Ortpy::ScratchArena::Buffer::GetData()
+{
+    return _storage.data.get();
+}
+
+Ortpy::ScratchArena::Buffer Ortpy::ScratchArena::Acquire(size_t size)
+{
+    _repackedBytes.fetch_add(size, std::memory_order_relaxed);
+    return Take(size);
+}
+
+Ortpy::ScratchArena::Buffer Ortpy::ScratchArena::AcquirePadding(size_t size)
+{
+    _paddedBytes.fetch_add(size, std::memory_order_relaxed);
+    return Take(size);
+}
+
+Ortpy::ScratchArena::Buffer Ortpy::ScratchArena::Take(size_t size)
+{
+    Storage storage;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        /** Take the smallest free buffer that fits. */
+        auto best = _free.end();
+        for (auto it = _free.begin(); it != _free.end(); ++it)
+        {
+            if (it->capacity >= size && (best == _free.end() || it->capacity < best->capacity))
+            {
+                best = it;
+            }
+        }
+        if (best != _free.end())
+        {
+            storage = std::move(*best);
+            _free.erase(best);
+        }
+    }
+    if (!storage.data)
+    {
+        /** Not zero filled, as the acquirer overwrites it anyway. */
+        storage.data = std::make_unique_for_overwrite<uint8_t[]>(size);
+        storage.capacity = size;
+    }
+    return Buffer{ shared_from_this(), std::move(storage) };
+}
+
+void Ortpy::ScratchArena::Release(Storage&& storage)
+{
+    if (!storage.data)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_free.size() < MaxFreeBuffers)
+    {
+        _free.push_back(std::move(storage));
+    }
+}
+
+uint64_t Ortpy::ScratchArena::GetRepackedBytes() const
+{
+    return _repackedBytes.load(std::memory_order_relaxed);
+}
+
+uint64_t Ortpy::ScratchArena::GetPaddedBytes() const
+{
+    return _paddedBytes.load(std::memory_order_relaxed);
+}
+
+/** RunMetrics */
+
+const char* Ortpy::RunMetrics::GetCounterName(Counter counter)
+{
+    switch (counter)
+    {
+        case Calls: return "calls";
+        case InputNs: return "input_ns";
+        case RunNs: return "run_ns";
+        case OutputNs: return "output_ns";
+        case BytesIn: return "bytes_in";
+        case BytesOut: return "bytes_out";
+        default: return "unknown";
+    }
+}
+
+Ortpy::RunMetrics::Stopwatch::Stopwatch(RunMetrics& metrics)
+{
+    if (metrics.IsEnabled())
+    {
+        _metrics = &metrics;
+        _metrics->Add(Calls, 1);
+        _last = std::chrono::steady_clock::now();
+    }
+}
+
+bool Ortpy::RunMetrics::Stopwatch::IsEnabled() const
+{
+    return _metrics != nullptr;
+}
+
+void Ortpy::RunMetrics::Stopwatch::Lap(Counter counter)
+{
+    if (_metrics)
+    {
+        auto now = std::chrono::steady_clock::now();
+        _metrics->Add(counter, static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - _last).count()));
+        _last = now;
+    }
+}
+
+void Ortpy::RunMetrics::Stopwatch::Add(Counter counter, uint64_t value)
+{
+    if (_metrics)
+    {
+        _metrics->Add(counter, value);
+    }
+}
+
+void Ortpy::RunMetrics::SetEnabled(bool enabled)
+{
+    _enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Ortpy::RunMetrics::IsEnabled() const
+{
+    return _enabled.load(std::memory_order_relaxed);
+}
+
+size_t Ortpy::RunMetrics::GetShardIndex()
+{
+    /** Threads are spread over the shards round robin, the first time they run. */
+    static std::atomic<size_t> nextIndex{ 0 };
+    thread_local size_t index = nextIndex.fetch_add(1, std::memory_order_relaxed) % NumShards;
+    return index;
+}
+
+void Ortpy::RunMetrics::Add(Counter counter, uint64_t value)
+{
+    _shards[GetShardIndex()].values[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+std::array<uint64_t, Ortpy::RunMetrics::NumCounters> Ortpy::RunMetrics::Snapshot() const
+{
+    /** Each counter is exact, but counters are not a consistent cut while runs are in flight. */
+    std::array<uint64_t, NumCounters> totals{};
+    for (const auto& shard : _shards)
+    {
+        for (size_t i = 0; i < NumCounters; i++)
+        {
+            totals[i] += shard.values[i].load(std::memory_order_relaxed);
+        }
+    }
+    return totals;
+}
+
+void Ortpy::RunMetrics::Reset()
+{
+    for (auto& shard : _shards)
+    {
+        for (auto& value : shard.values)
+        {
+            value.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+/** IoBinding */
+
+void Ortpy::IoBinding::ReleaseOrtType(OrtIoBinding* ptr)
+{
+    GetApi()->ReleaseIoBinding(ptr);
+}
+
+Ortpy::IoBinding::IoBinding(const Session& session)
+    : OrtTypeWrapper<OrtIoBinding, IoBinding>(nullptr)
+{
+    Ortpy::Status status = GetApi()->CreateIoBinding(session, &_ptr);
+    status.Check();
+    _scratchArena = session.GetScratchArena().shared_from_this();
+    for (const auto& name : session.GetInputNames())
+    {
+        auto type = session.GetRawViewInputType(name);
+        if (type != ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED)
+        {
+            _rawViewInputTypes.emplace(name, type);
+        }
+    }
+}
+
+void Ortpy::IoBinding::BindInput(const std::string& name, const InputArray& array)
+{
+    auto it = _rawViewInputTypes.find(name);
+    Value value{ array, it != _rawViewInputTypes.end() ? it->second : ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED,
+        _scratchArena.get() };
+    Ortpy::Status status = GetApi()->BindInput(_ptr, name.c_str(), value);
+    status.Check();
+    _inputs.insert_or_assign(name, std::move(value));
+}
+
+void Ortpy::IoBinding::BindInput(const std::string& name, const StringTensor& strings)
+{
+    const Value& value = strings.GetValue();
+    Ortpy::Status status = GetApi()->BindInput(_ptr, name.c_str(), value);
+    status.Check();
+    _inputs.insert_or_assign(name, value);
+}
+
+void Ortpy::IoBinding::BindOutput(const std::string& name, const InputArray& array)
+{
+    /** ort writes the results into the caller's array directly. A repacked copy would never be seen. */
+    if (!IsCContiguous(array))
+    {
+        throw std::invalid_argument("Output array for " + name + " must be C contiguous");
+    }
+    Value value{ array };
+    Ortpy::Status status = GetApi()->BindOutput(_ptr, name.c_str(), value);
+    status.Check();
+    _outputs.insert_or_assign(name, std::move(value));
+}
+
+void Ortpy::IoBinding::BindOutputToCpu(const std::string& name)
+{
+    /** Let ort allocate the output as we may not known its shape. */
+    Ortpy::Status status = GetApi()->BindOutputToDevice(_ptr, name.c_str(), GetCpuMemoryInfo());
+    status.Check();
+    _outputs.erase(name);
+}
+
+void Ortpy::IoBinding::ClearBoundInputs()
+{
+    GetApi()->ClearBoundInputs(_ptr);
+    _inputs.clear();
+}
+
+void Ortpy::IoBinding::ClearBoundOutputs()
+{
+    GetApi()->ClearBoundOutputs(_ptr);
+    _outputs.clear();
+}
+
+nanobind::dict Ortpy::IoBinding::GetOutputs(ArrayFramework outputFramework) const
+{
+    auto allocator = GetAllocator();
+    char* namesRaw = nullptr;
+    size_t* lengthsRaw = nullptr;
+    size_t nameCount = 0;
+    Ortpy::Status status = GetApi()->GetBoundOutputNames(_ptr, allocator, &namesRaw, &lengthsRaw, &nameCount);
+    status.Check();
+    /** The names are packed into one buffer without null terminators. */
+    std::vector<std::string> names;
+    names.reserve(nameCount);
+    size_t offset = 0;
+    for (size_t i = 0; i < nameCount; i++)
+    {
+        names.emplace_back(namesRaw + offset, lengthsRaw[i]);
+        offset += lengthsRaw[i];
+    }
+    if (namesRaw)
+    {
+        allocator->Free(allocator, namesRaw);
+    }
+    if (lengthsRaw)
+    {
+        allocator->Free(allocator, lengthsRaw);
+    }
+    OrtValue** valuesRaw = nullptr;
+    size_t valueCount = 0;
+    status = GetApi()->GetBoundOutputValues(_ptr, allocator, &valuesRaw, &valueCount);
+    status.Check();
+    std::vector<Value> values;
+    values.reserve(valueCount);
+    for (size_t i = 0; i < valueCount; i++)
+    {
+        /** safe guard the raw values first. */
+        values.emplace_back(valuesRaw[i]);
+    }
+    if (valuesRaw)
+    {
+        allocator->Free(allocator, valuesRaw);
+    }
+    if (values.size() != names.size())
+    {
+        throw std::runtime_error("Bound output names and values do not match");
+    }
+    nanobind::dict outputs;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        /**
+         * The arrays are views of the bound buffers, no copy is made.
+         * An output bound to an array is viewed through the stored value, which keeps that array alive.
+         */
+        auto it = _outputs.find(names[i]);
+        const Value& value = it != _outputs.end() ? it->second : values[i];
+        outputs[names[i].c_str()] = value.ToPython(outputFramework);
+    }
+    return outputs;
+}
+
+/** MemoryInfo */
+
+Ortpy::MemoryInfo::MemoryInfo()
+    : OrtTypeWrapper<OrtMemoryInfo, MemoryInfo>(nullptr)
+{
+    Ortpy::Status status = GetApi()->CreateCpuMemoryInfo(OrtArenaAllocator, OrtMemTypeDefault, &_ptr);
+    status.Check();
+}
+
+void Ortpy::MemoryInfo::ReleaseOrtType(OrtMemoryInfo* ptr)
+{
+    GetApi()->ReleaseMemoryInfo(ptr);
+}
+
+/** ProfileSummary */
+
+/** A minimal reader for the profiler's json. Only the fields the aggregation needs are decoded. */
+class ProfileJsonReader
+{
+public:
+    struct Event
+    {
+        std::string category;
+        std::string name;
+        std::string opName;
+        std::string provider;
+        int64_t durationUs{ 0 };
+    };
+
+    ProfileJsonReader(std::string_view text)
+        : _text(text)
+    {
+    }
+
+    /** The profile is a single array of events. Calls onEvent for each one. */
+    template <typename OnEvent>
+    void ReadEvents(OnEvent&& onEvent)
+    {
+        Expect('[');
+        if (TryConsume(']'))
+        {
+            return;
+        }
+        do
+        {
+            Event event{};
+            ReadEvent(event);
+            onEvent(event);
+        } while (TryConsume(','));
+        Expect(']');
+    }
+
+private:
+    [[noreturn]] void Fail() const
+    {
+        throw std::runtime_error("Invalid profile json at offset " + std::to_string(_pos));
+    }
+
+    void SkipWhitespace()
+    {
+        while (_pos < _text.size() &&
+            (_text[_pos] == ' ' || _text[_pos] == '\n' || _text[_pos] == '\r' || _text[_pos] == '\t'))
+        {
+            _pos++;
+        }
+    }
+
+    char Peek()
+    {
+        SkipWhitespace();
+        if (_pos >= _text.size())
+        {
+            Fail();
+        }
+        return _text[_pos];
+    }
+
+    bool TryConsume(char c)
+    {
+        if (Peek() == c)
+        {
+            _pos++;
+            return true;
+        }
+        return false;
+    }
+
+    void Expect(char c)
+    {
+        if (!TryConsume(c))
+        {
+            Fail();
+        }
+    }
+
+    static void AppendUtf8(std::string& out, uint32_t codePoint)
+    {
+        char encoded[4];
+        out.append(encoded, EncodeUtf8(encoded, codePoint));
+    }
+
+    uint32_t ReadHex4()
+    {
+        if (_pos + 4 > _text.size())
+        {
+            Fail();
+        }
+        uint32_t value = 0;
+        auto result = std::from_chars(_text.data() + _pos, _text.data() + _pos + 4, value, 16);
+        if (result.ptr != _text.data() + _pos + 4)
+        {
+            Fail();
+        }
+        _pos += 4;
+        return value;
+    }
+
+    /** Decodes into out, or only skips the string if out is null. */
+    void ReadString(std::string* out)
+    {
+        Expect('"');
+        while (true)
+        {
+            if (_pos >= _text.size())
+            {
+                Fail();
+            }
+            char c = _text[_pos++];
+            if (c == '"')
+            {
+                return;
+            }
+            if (c != '\\')
+            {
+                if (out)
+                {
+                    *out += c;
+                }
+                continue;
+            }
+            if (_pos >= _text.size())
+            {
+                Fail();
+            }
+            char escaped = _text[_pos++];
+            char decoded = 0;
+            switch (escaped)
+            {
+                case '"': decoded = '"'; break;
+                case '\\': decoded = '\\'; break;
+                case '/': decoded = '/'; break;
+                case 'b': decoded = '\b'; break;
+                case 'f': decoded = '\f'; break;
+                case 'n': decoded = '\n'; break;
+                case 'r': decoded = '\r'; break;
+                case 't': decoded = '\t'; break;
+                case 'u':
+                {
+                    uint32_t codePoint = ReadHex4();
+                    /** A surrogate pair */
+                    if (codePoint >= 0xd800 && codePoint < 0xdc00 &&
+                        _pos + 1 < _text.size() && _text[_pos] == '\\' && _text[_pos + 1] == 'u')
+                    {
+                        _pos += 2;
+                        uint32_t low = ReadHex4();
+                        codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    if (out)
+                    {
+                        AppendUtf8(*out, codePoint);
+                    }
+                    continue;
+                }
+                default:
+                    Fail();
+            }
+            if (out)
+            {
+                *out += decoded;
+            }
+        }
+    }
+
+    double ReadNumber()
+    {
+        SkipWhitespace();
+        size_t end = _pos;
+        while (end < _text.size() && std::strchr("+-0123456789.eE", _text[end]) != nullptr)
+        {
+            end++;
+        }
+        double value = 0;
+        auto result = std::from_chars(_text.data() + _pos, _text.data() + end, value);
+        if (result.ptr != _text.data() + end || end == _pos)
+        {
+            Fail();
+        }
+        _pos = end;
+        return value;
+    }
+
+    void SkipLiteral(std::string_view literal)
+    {
+        SkipWhitespace();
+        if (_text.substr(_pos, literal.size()) != literal)
+        {
+            Fail();
+        }
+        _pos += literal.size();
     }
-    size_t size = typeSize;
-    for (const auto& dim : shape)
+
+    void SkipValue()
     {
-        if (dim < 0)
+        char c = Peek();
+        switch (c)
         {
-            throw std::runtime_error("Invalid dimension size: " + std::to_string(dim));
+            case '"':
+                ReadString(nullptr);
+                return;
+            case '{':
+                _pos++;
+                if (TryConsume('}'))
+                {
+                    return;
+                }
+                do
+                {
+                    ReadString(nullptr);
+                    Expect(':');
+                    SkipValue();
+                } while (TryConsume(','));
+                Expect('}');
+                return;
+            case '[':
+                _pos++;
+                if (TryConsume(']'))
+                {
+                    return;
+                }
+                do
+                {
+                    SkipValue();
+                } while (TryConsume(','));
+                Expect(']');
+                return;
+            case 't':
+                SkipLiteral("true");
+                return;
+            case 'f':
+                SkipLiteral("false");
+                return;
+            case 'n':
+                SkipLiteral("null");
+                return;
+            default:
+                ReadNumber();
+                return;
         }
-        size *= static_cast<size_t>(dim);
     }
-    return size;
-}
 
-void* Ortpy::Value::GetData() const
-{
-    if (_state->ortValue == nullptr)
+    /** Reads the keys of an object, calling onMember for each. It must consume the value. */
+    template <typename OnMember>
+    void ReadObject(OnMember&& onMember)
     {
-        throw std::runtime_error("Value is empty");
+        Expect('{');
+        if (TryConsume('}'))
+        {
+            return;
+        }
+        std::string key;
+        do
+        {
+            key.clear();
+            ReadString(&key);
+            Expect(':');
+            onMember(key);
+        } while (TryConsume(','));
+        Expect('}');
     }
-    void* data = nullptr;
-    Ortpy::Status status = GetApi()->GetTensorMutableData(_state->ortValue, &data);
-    if (data == nullptr)
+
+    void ReadEvent(Event& event)
     {
-        throw std::runtime_error("Failed to get data from OrtValue.");
+        ReadObject([&](const std::string& key) {
+            if (key == "cat")
+            {
+                ReadString(&event.category);
+            }
+            else if (key == "name")
+            {
+                ReadString(&event.name);
+            }
+            else if (key == "dur")
+            {
+                event.durationUs = static_cast<int64_t>(ReadNumber());
+            }
+            else if (key == "args" && Peek() == '{')
+            {
+                ReadObject([&](const std::string& argKey) {
+                    if (argKey == "op_name" && Peek() == '"')
+                    {
+                        ReadString(&event.opName);
+                    }
+                    else if (argKey == "provider" && Peek() == '"')
+                    {
+                        ReadString(&event.provider);
+                    }
+                    else
+                    {
+                        SkipValue();
+                    }
+                });
+            }
+            else
+            {
+                SkipValue();
+            }
+        });
     }
-    return data;
-}
 
-ONNXTensorElementDataType Ortpy::Value::NpTypeToOrtType(const nanobind::dlpack::dtype& npType)
+    std::string_view _text;
+    size_t _pos{ 0 };
+};
+
+/** Reorders the columns by descending total time. */
+template <typename... Columns>
+static void SortByTotal(std::vector<int64_t>& totals, Columns&... columns)
 {
-    static std::map<nanobind::dlpack::dtype, ONNXTensorElementDataType> typeMap{};
-    if (typeMap.empty())
+    std::vector<size_t> order(totals.size());
+    for (size_t i = 0; i < order.size(); i++)
     {
-        typeMap[nanobind::dtype<bool>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL;
-        typeMap[nanobind::dtype<int8_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8;
-        typeMap[nanobind::dtype<uint8_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8;
-        typeMap[nanobind::dtype<int16_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16;
-        typeMap[nanobind::dtype<uint16_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16;
-        typeMap[nanobind::dtype<int32_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32;
-        typeMap[nanobind::dtype<uint32_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32;
-        typeMap[nanobind::dtype<int64_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64;
-        typeMap[nanobind::dtype<uint64_t>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64;
-        typeMap[nanobind::dtype<float>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
-        typeMap[nanobind::dtype<double>()] = ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE;
-        typeMap[{ static_cast<uint8_t>(nanobind::dlpack::dtype_code::Float), 16, 1 }] = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16;
+        order[i] = i;
     }
-    auto it = typeMap.find(npType);
-    if (it == typeMap.end())
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return totals[a] > totals[b]; });
+    auto permute = [&](auto& column) {
+        std::remove_reference_t<decltype(column)> sorted;
+        sorted.reserve(column.size());
+        for (size_t index : order)
+        {
+            sorted.push_back(std::move(column[index]));
+        }
+        column = std::move(sorted);
+    };
+    (permute(columns), ...);
+    permute(totals);
+}
+
+Ortpy::ProfileSummary Ortpy::ProfileSummary::Parse(const std::string& profilePath)
+{
+    std::ifstream file{ Utf8ToPath(profilePath), std::ios::binary };
+    if (!file)
     {
-        throw std::runtime_error("Unsupported NumPy data type: " + std::to_string(npType.code) + ", " + std::to_string(npType.bits) + ", " + std::to_string(npType.lanes));
+        throw std::runtime_error("Failed to open " + profilePath);
     }
-    return it->second;
+    std::stringstream content;
+    content << file.rdbuf();
+    std::string text = content.str();
+
+    static constexpr std::string_view kernelSuffix = "_kernel_time";
+    ProfileSummary summary{};
+    std::unordered_map<std::string, size_t> nodeIndices;
+    std::unordered_map<std::string, size_t> opIndices;
+    ProfileJsonReader reader{ text };
+    reader.ReadEvents([&](ProfileJsonReader::Event& event) {
+        if (event.category == "Session" && event.name == "model_run")
+        {
+            summary.numRuns++;
+            summary.runTotalUs += event.durationUs;
+            return;
+        }
+        if (event.category != "Node" || event.name.size() <= kernelSuffix.size() ||
+            std::string_view(event.name).substr(event.name.size() - kernelSuffix.size()) != kernelSuffix)
+        {
+            return;
+        }
+        event.name.resize(event.name.size() - kernelSuffix.size());
+        auto [nodeIt, nodeInserted] = nodeIndices.try_emplace(event.name, summary.nodeNames.size());
+        if (nodeInserted)
+        {
+            summary.nodeNames.push_back(event.name);
+            summary.nodeOpTypes.push_back(event.opName);
+            summary.nodeProviders.push_back(event.provider);
+            summary.nodeTotalUs.push_back(0);
+            summary.nodeCounts.push_back(0);
+        }
+        summary.nodeTotalUs[nodeIt->second] += event.durationUs;
+        summary.nodeCounts[nodeIt->second]++;
+        auto [opIt, opInserted] = opIndices.try_emplace(event.opName, summary.opTypes.size());
+        if (opInserted)
+        {
+            summary.opTypes.push_back(event.opName);
+            summary.opTotalUs.push_back(0);
+            summary.opCounts.push_back(0);
+        }
+        summary.opTotalUs[opIt->second] += event.durationUs;
+        summary.opCounts[opIt->second]++;
+    });
+    SortByTotal(summary.nodeTotalUs, summary.nodeNames, summary.nodeOpTypes, summary.nodeProviders, summary.nodeCounts);
+    SortByTotal(summary.opTotalUs, summary.opTypes, summary.opCounts);
+    return summary;
 }
 
-nanobind::dlpack::dtype Ortpy::Value::OrtTypeToNpType(ONNXTensorElementDataType ortType)
+/** Benchmark */
+
+/** The resident memory of the process now. Zero if unknown. */
+static uint64_t GetCurrentRss()
 {
-    switch (ortType) {
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
-            return nanobind::dtype<float>();
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
-            return nanobind::dtype<uint8_t>();
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:
-            return nanobind::dtype<int8_t>();
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:
-            return nanobind::dtype<uint16_t>();
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:
-            return nanobind::dtype<int16_t>();
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
-            return nanobind::dtype<int32_t>();
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
-            return nanobind::dtype<int64_t>();
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:
-            return nanobind::dtype<bool>();
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
-            return { static_cast<uint8_t>(nanobind::dlpack::dtype_code::Float), 16, 1 };
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:
-            return nanobind::dtype<double>();
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32:
-            return nanobind::dtype<uint32_t>();
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64:
-            return nanobind::dtype<uint64_t>();
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return 0;
     }
-    throw std::runtime_error("Unsupported ONNX tensor element data type: " + std::to_string(ortType));
+    return counters.WorkingSetSize;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info{};
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+    {
+        return 0;
+    }
+    return info.resident_size;
+#elif defined(__linux__)
+    /** The second field is the resident size in pages. */
+    std::ifstream statm("/proc/self/statm");
+    uint64_t sizePages = 0;
+    uint64_t residentPages = 0;
+    if (!(statm >> sizePages >> residentPages))
+    {
+        return 0;
+    }
+    return residentPages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif /** _WIN32 */
 }
 
-std::string Ortpy::Value::NpTypeToName(const nanobind::dlpack::dtype& npType)
+/** Good enough for generated data. Tiny values are flushed to zero. */
+static uint16_t FloatToHalf(float value)
 {
-    static std::map<nanobind::dlpack::dtype, std::string> typeMap{};
-    if (typeMap.empty())
+    uint32_t bits = std::bit_cast<uint32_t>(value);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (exponent <= 0)
     {
-        typeMap[nanobind::dtype<bool>()] = "bool";
-        typeMap[nanobind::dtype<int8_t>()] = "int8";
-        typeMap[nanobind::dtype<uint8_t>()] = "uint8";
-        typeMap[nanobind::dtype<int16_t>()] = "int16";
-        typeMap[nanobind::dtype<uint16_t>()] = "uint16";
-        typeMap[nanobind::dtype<int32_t>()] = "int32";
-        typeMap[nanobind::dtype<uint32_t>()] = "uint32";
-        typeMap[nanobind::dtype<int64_t>()] = "int64";
-        typeMap[nanobind::dtype<uint64_t>()] = "uint64";
-        typeMap[nanobind::dtype<float>()] = "float32";
-        typeMap[nanobind::dtype<double>()] = "float64";
-        typeMap[{ static_cast<uint8_t>(nanobind::dlpack::dtype_code::Float), 16, 1 }] = "float16";
+        return static_cast<uint16_t>(sign);
     }
-    auto it = typeMap.find(npType);
-    if (it == typeMap.end())
+    if (exponent >= 31)
     {
-        throw std::runtime_error("Unsupported NumPy data type: " + std::to_string(npType.code) + ", " + std::to_string(npType.bits) + ", " + std::to_string(npType.lanes));
+        return static_cast<uint16_t>(sign | 0x7c00);
     }
-    return it->second;
+    return static_cast<uint16_t>(sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13));
 }
 
-size_t Ortpy::Value::GetSizeOfOrtType(ONNXTensorElementDataType ortType)
+/**
+ * Floats are uniform in [0, 1). Everything else is zero, which is always a valid index.
+ * A raw tensor without any python object, as it is created without the GIL.
+ */
+static Ortpy::TensorView CreateBenchmarkInput(
+    const Ortpy::TensorInfo& info, const std::vector<int64_t>& shape, std::mt19937& random)
 {
-    switch (ortType) {
+    auto type = info.type;
+    OrtValue* valueRaw = nullptr;
+    Ortpy::Status status = Ortpy::GetApi()->CreateTensorAsOrtValue(
+        Ortpy::GetAllocator(), shape.data(), shape.size(), type, &valueRaw);
+    status.Check();
+    Ortpy::TensorView value{ valueRaw };
+    if (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING)
+    {
+        /** Empty strings */
+        return value;
+    }
+    void* data = nullptr;
+    status = Ortpy::GetApi()->GetTensorMutableData(value, &data);
+    status.Check();
+    size_t count = 1;
+    for (auto dim : shape)
+    {
+        count *= static_cast<size_t>(dim);
+    }
+    size_t size = Ortpy::Value::IsPackedType(type) ? (count + 1) / 2 : count * Ortpy::Value::GetSizeOfOrtType(type);
+    std::uniform_real_distribution<float> uniform{ 0.0f, 1.0f };
+    switch (type)
+    {
         case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
-            return sizeof(float);
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
-            return sizeof(uint8_t);
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:
-            return sizeof(int8_t);
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:
-            return sizeof(uint16_t);
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:
-            return sizeof(int16_t);
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
-            return sizeof(int32_t);
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
-            return sizeof(int64_t);
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:
-            return sizeof(bool);
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
-            return 2;
+            for (size_t i = 0; i < size / sizeof(float); i++)
+            {
+                static_cast<float*>(data)[i] = uniform(random);
+            }
+            break;
         case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:
-            return sizeof(double);
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32:
-            return sizeof(uint32_t);
-        case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64:
-            return sizeof(uint64_t);
+            for (size_t i = 0; i < size / sizeof(double); i++)
+            {
+                static_cast<double*>(data)[i] = uniform(random);
+            }
+            break;
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+            for (size_t i = 0; i < size / sizeof(uint16_t); i++)
+            {
+                static_cast<uint16_t*>(data)[i] = FloatToHalf(uniform(random));
+            }
+            break;
+        case ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16:
+            for (size_t i = 0; i < size / sizeof(uint16_t); i++)
+            {
+                /** The upper half of a float, truncated. */
+                static_cast<uint16_t*>(data)[i] = static_cast<uint16_t>(std::bit_cast<uint32_t>(uniform(random)) >> 16);
+            }
+            break;
+        default:
+            std::memset(data, 0, size);
+            break;
     }
-    throw std::runtime_error("Unsupported ONNX tensor element data type: " + std::to_string(ortType));
+    return value;
 }
 
-/** MemoryInfo */
+static double Percentile(const std::vector<double>& sorted, double percentile)
+{
+    /** Nearest rank */
+    size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * static_cast<double>(sorted.size())));
+    rank = std::clamp<size_t>(rank, 1, sorted.size());
+    return sorted[rank - 1];
+}
 
-Ortpy::MemoryInfo::MemoryInfo()
-    : OrtTypeWrapper<OrtMemoryInfo, MemoryInfo>(nullptr)
+static Ortpy::BenchmarkResult BenchmarkOnce(
+    const Ortpy::Session& session,
+    const std::vector<const char*>& inputNames,
+    const std::vector<const OrtValue*>& inputValues,
+    const std::vector<const char*>& outputNames,
+    size_t numThreads,
+    size_t warmupRuns,
+    size_t timedRuns)
 {
-    Ortpy::Status status = GetApi()->CreateCpuMemoryInfo(OrtArenaAllocator, OrtMemTypeDefault, &_ptr);
-    status.Check();
+    using Clock = std::chrono::steady_clock;
+    uint64_t rssBefore = GetCurrentRss();
+    std::vector<std::vector<double>> latencies(numThreads);
+    std::mutex errorMutex;
+    std::string error;
+    /** The timer starts once every thread is warmed up. */
+    std::latch warmedUp{ static_cast<ptrdiff_t>(numThreads + 1) };
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads);
+    for (size_t t = 0; t < numThreads; t++)
+    {
+        threads.emplace_back([&, t]() {
+            auto& threadLatencies = latencies[t];
+            threadLatencies.reserve(timedRuns);
+            std::vector<OrtValue*> outputs(outputNames.size(), nullptr);
+            bool failed = false;
+            for (size_t i = 0; i < warmupRuns + timedRuns; i++)
+            {
+                if (i == warmupRuns)
+                {
+                    /** Reached exactly once, as there is at least one timed run. */
+                    warmedUp.arrive_and_wait();
+                }
+                if (failed)
+                {
+                    continue;
+                }
+                auto begin = Clock::now();
+                Ortpy::Status status = Ortpy::GetApi()->Run(
+                    session, nullptr,
+                    inputNames.data(), inputValues.data(), inputValues.size(),
+                    outputNames.data(), outputNames.size(), outputs.data());
+                auto end = Clock::now();
+                for (auto& output : outputs)
+                {
+                    if (output)
+                    {
+                        Ortpy::GetApi()->ReleaseValue(output);
+                        output = nullptr;
+                    }
+                }
+                if (status != nullptr)
+                {
+                    /** Keep arriving at the latch, so the other threads are not stuck. */
+                    failed = true;
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    error = status.GetErrorMessage();
+                    continue;
+                }
+                if (i >= warmupRuns)
+                {
+                    threadLatencies.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+                }
+            }
+        });
+    }
+    warmedUp.arrive_and_wait();
+    auto start = Clock::now();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    double elapsedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (!error.empty())
+    {
+        throw std::runtime_error(error);
+    }
+
+    std::vector<double> all;
+    all.reserve(numThreads * timedRuns);
+    for (const auto& threadLatencies : latencies)
+    {
+        all.insert(all.end(), threadLatencies.begin(), threadLatencies.end());
+    }
+    std::sort(all.begin(), all.end());
+    Ortpy::BenchmarkResult result{};
+    result.numThreads = numThreads;
+    result.numRuns = all.size();
+    if (!all.empty())
+    {
+        double sum = 0;
+        for (double latency : all)
+        {
+            sum += latency;
+        }
+        result.meanMs = sum / static_cast<double>(all.size());
+        result.p50Ms = Percentile(all, 50);
+        result.p90Ms = Percentile(all, 90);
+        result.p99Ms = Percentile(all, 99);
+    }
+    if (elapsedSeconds > 0)
+    {
+        result.runsPerSecond = static_cast<double>(all.size()) / elapsedSeconds;
+    }
+    result.rssIncreaseBytes = static_cast<int64_t>(GetCurrentRss()) - static_cast<int64_t>(rssBefore);
+    return result;
 }
 
-void Ortpy::MemoryInfo::ReleaseOrtType(OrtMemoryInfo* ptr)
+std::vector<Ortpy::BenchmarkResult> Ortpy::Benchmark(
+    const Session& session,
+    const std::unordered_map<std::string, int64_t>& dimensionOverrides,
+    const std::vector<size_t>& threadCounts,
+    const std::vector<int64_t>& batchSizes,
+    size_t warmupRuns,
+    size_t timedRuns)
 {
-    GetApi()->ReleaseMemoryInfo(ptr);
+    if (timedRuns == 0)
+    {
+        throw std::invalid_argument("timed_runs must be positive");
+    }
+    for (size_t numThreads : threadCounts)
+    {
+        if (numThreads == 0)
+        {
+            throw std::invalid_argument("Thread counts must be positive");
+        }
+    }
+    for (int64_t batchSize : batchSizes)
+    {
+        if (batchSize <= 0)
+        {
+            throw std::invalid_argument("Batch sizes must be positive");
+        }
+    }
+    auto inputInfo = session.GetInputInfo();
+    const auto& inputNamesStorage = session.GetInputNames();
+    const auto& outputNamesStorage = session.GetOutputNames();
+    std::vector<const char*> inputNames;
+    inputNames.reserve(inputNamesStorage.size());
+    for (const auto& name : inputNamesStorage)
+    {
+        inputNames.push_back(name.c_str());
+        if (inputInfo.at(name).type == ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED)
+        {
+            throw std::invalid_argument("Input " + name + " is not a tensor and cannot be generated");
+        }
+    }
+    std::vector<const char*> outputNames;
+    outputNames.reserve(outputNamesStorage.size());
+    for (const auto& name : outputNamesStorage)
+    {
+        outputNames.push_back(name.c_str());
+    }
+
+    std::vector<BenchmarkResult> results;
+    /** Fixed seed, so runs are reproducible. */
+    std::mt19937 random{ 0 };
+    nanobind::gil_scoped_release release;
+    for (int64_t batchSize : batchSizes)
+    {
+        std::vector<TensorView> inputs;
+        inputs.reserve(inputNames.size());
+        std::vector<const OrtValue*> inputValues;
+        inputValues.reserve(inputNames.size());
+        for (const auto& name : inputNamesStorage)
+        {
+            const auto& info = inputInfo.at(name);
+            std::vector<int64_t> shape = info.shape;
+            for (size_t d = 0; d < shape.size(); d++)
+            {
+                if (shape[d] > 0)
+                {
+                    continue;
+                }
+                auto it = d < info.dimensions.size() ? dimensionOverrides.find(info.dimensions[d]) : dimensionOverrides.end();
+                if (it != dimensionOverrides.end())
+                {
+                    shape[d] = it->second;
+                }
+                else
+                {
+                    shape[d] = d == 0 ? batchSize : 1;
+                }
+            }
+            inputs.push_back(CreateBenchmarkInput(info, shape, random));
+            inputValues.push_back(inputs.back());
+        }
+        for (size_t numThreads : threadCounts)
+        {
+            auto result = BenchmarkOnce(session, inputNames, inputValues, outputNames, numThreads, warmupRuns, timedRuns);
+            result.batchSize = batchSize;
+            result.samplesPerSecond = result.runsPerSecond * static_cast<double>(batchSize);
+            results.push_back(result);
+        }
+    }
+    return results;
 }
@@ -5,6 +5,15 @@
 #include <vector>
 #include <optional>
 #include <functional>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <array>
+#include <variant>
 
 /** Use the C API for maximum compatibility */
 #include <onnxruntime_c_api.h>
@@ -12,9 +21,30 @@
 namespace Ortpy
 {
     using NpArray = nanobind::ndarray<nanobind::numpy, nanobind::device::cpu, nanobind::c_contig>;
+    /**
+     * Any cpu array exposing DLPack or the buffer protocol, e.g. numpy, torch or jax.
+     * Contiguous arrays are used without a copy. Strided ones are repacked by the binding code.
+     */
+    using InputArray = nanobind::ndarray<nanobind::device::cpu>;
+    class StringTensor;
+    class ScratchArena;
+    /** A session input. Arrays of numbers, or strings as they can not be viewed through DLPack. */
+    using SessionInput = std::variant<InputArray, std::reference_wrapper<StringTensor>>;
+
+    /** The python type the outputs are returned as. */
+    enum class ArrayFramework
+    {
+        Numpy,
+        PyTorch,
+        Jax,
+        /** A framework agnostic array implementing __dlpack__ and the buffer protocol. */
+        DLPack,
+    };
 
     const OrtApi* GetApi();
     OrtAllocator* GetAllocator();
+    /** Shared by all the tensors created upon cpu memory. DO NOT free this. */
+    const OrtMemoryInfo* GetCpuMemoryInfo();
     std::unordered_map<std::string, std::string> KeyValuePairsToMap(const OrtKeyValuePairs* pairs);
 
     template <typename T, typename Derived>
@@ -96,17 +126,54 @@ namespace Ortpy
         const OrtEpDevice* _ptr{ nullptr };
     };
 
+    class ThreadingOptions : public OrtTypeWrapper<OrtThreadingOptions, ThreadingOptions>
+    {
+    public:
+        static void ReleaseOrtType(OrtThreadingOptions* ptr);
+        ThreadingOptions();
+        void SetGlobalIntraOpNumThreads(int intraOpNumThreads);
+        void SetGlobalInterOpNumThreads(int interOpNumThreads);
+        void SetGlobalSpinControl(bool allowSpinning);
+        void SetGlobalDenormalAsZero();
+        void SetGlobalIntraOpThreadAffinity(const std::string& affinity);
+    };
+
     class Env : public OrtTypeWrapper<OrtEnv, Env>
     {
     public:
         static std::shared_ptr<Env> GetSingleton();
+        /** Must be called before anything else creates the singleton. */
+        static void InitializeWithGlobalThreadPools(const ThreadingOptions& options);
         static void ReleaseOrtType(OrtEnv* ptr);
         void RegisterExecutionProviderLibrary(const std::string& name, const std::string& path);
         void UnregisterExecutionProviderLibrary(const std::string& name);
         std::vector<EpDevice> GetEpDevices() const;
     private:
         static std::shared_ptr<Env> _instance;
+        /** Sessions may be created concurrently without the GIL. */
+        static std::mutex _instanceMutex;
         Env();
+        Env(const ThreadingOptions& options);
+    };
+
+    /**
+     * A read only view of any python buffer protocol object, e.g. bytes, memoryview, mmap or numpy arrays.
+     * The object is kept alive and its buffer locked until the view is destroyed.
+     */
+    class PyBuffer
+    {
+    public:
+        PyBuffer(const nanobind::object& object);
+        ~PyBuffer();
+        PyBuffer(const PyBuffer&) = delete;
+        PyBuffer& operator=(const PyBuffer&) = delete;
+        PyBuffer(PyBuffer&&) = delete;
+        PyBuffer& operator=(PyBuffer&&) = delete;
+        const void* GetData() const;
+        size_t GetSize() const;
+        bool IsReadOnly() const;
+    private:
+        Py_buffer _view{};
     };
 
     class ModelCompilationOptions : public OrtTypeWrapper<OrtModelCompilationOptions, ModelCompilationOptions>
@@ -115,12 +182,15 @@ namespace Ortpy
         static void ReleaseOrtType(OrtModelCompilationOptions* ptr);
         using OrtTypeWrapper::OrtTypeWrapper;
         void SetInputModelPath(const std::string& path);
-        void SetInputModelFromBuffer(const nanobind::bytes& modelBytes);
+        void SetInputModelFromBuffer(const nanobind::object& modelBytes);
         void SetOutputModelExternalInitializersFile(
             const std::string& path, size_t externalInitializerSizeThreshold);
         void SetEpContextEmbedMode(bool embedContext);
         void CompileModelToFile(const std::string& path);
         nanobind::bytes CompileModelToBuffer();
+    private:
+        /** ort reads the input model buffer when compiling, not when it is set. */
+        std::shared_ptr<const PyBuffer> _inputModel;
     };
 
     class LibraryHandle : public OrtTypeWrapper<void, LibraryHandle>
@@ -130,6 +200,8 @@ namespace Ortpy
         using OrtTypeWrapper::OrtTypeWrapper;
     };
 
+    class Value;
+
     class SessionOptions : public OrtTypeWrapper<OrtSessionOptions, SessionOptions>
     {
     public:
@@ -139,6 +211,11 @@ namespace Ortpy
 
         SessionOptions();
         using OrtTypeWrapper::OrtTypeWrapper;
+        /**
+         * An independent copy of the options.
+         * A selection delegate is shared with this instance, which must then outlive the copy.
+         */
+        SessionOptions Clone() const;
         void SetOptimizedModelFilePath(const std::string& path);
         void SetSessionExecutionMode(ExecutionMode mode);
         void EnableProfiling(const std::string& profileFilePrefix);
@@ -153,6 +230,14 @@ namespace Ortpy
         void SetSessionGraphOptimizationLevel(GraphOptimizationLevel level);
         void SetIntraOpNumThreads(int intraOpNumThreads);
         void SetInterOpNumThreads(int interOpNumThreads);
+        void DisablePerSessionThreads();
+        void AddSessionConfigEntry(const std::string& key, const std::string& value);
+        /** Fixes a symbolic dimension by its denotation, e.g. DATA_BATCH. */
+        void AddFreeDimensionOverride(const std::string& dimensionDenotation, int64_t dimensionValue);
+        /** Fixes a symbolic dimension by the name reported in TensorInfo::dimensions. */
+        void AddFreeDimensionOverrideByName(const std::string& dimensionName, int64_t dimensionValue);
+        /** A clone with the dimensions fixed, for sessions specialized to one shape. */
+        SessionOptions WithFreeDimensionOverrides(const std::unordered_map<std::string, int64_t>& dimensions) const;
         LibraryHandle RegisterCustomOpsLibrary(const std::string& libraryPath);
         void AppendExecutionProvider_V2(
             const std::vector<EpDevice>& epDevices,
@@ -165,9 +250,55 @@ namespace Ortpy
                 const std::unordered_map<std::string, std::string>& runtimeMetadata,
                 size_t max_selected)>;
         void SetEpSelectionPolicyDelegate(const EpSelectionPolicyDelegate& delegate);
+        /**
+         * The array is used in place. It is shared by every session created with these options.
+         * The caches key it by its content when it is added, so it must not change afterwards.
+         */
+        void AddInitializer(const std::string& name, const InputArray& array);
+        void AddExternalInitializers(const std::vector<std::string>& names, const std::vector<InputArray>& arrays);
+        /** Sessions keep these alive, as ort does not own them. */
+        const std::vector<Value>& GetInitializers() const;
+        /** Identifies the initializers by name, type, shape and content. */
+        const std::string& GetInitializersKey() const;
+        /**
+         * Sessions load compiled EP context models from the directory, or compile and store them on a miss.
+         * The models are keyed by their content, the execution providers with their options, the initializers
+         *     added to the options and the ort version.
+         * Only used when an execution provider is selected, as the CPU alone has nothing to compile.
+         */
+        void SetCompileCacheDirectory(const std::string& directory);
+        const std::string& GetCompileCacheDirectory() const;
+        /**
+         * Sessions save their optimized model to the directory in ORT format, and later sessions load it
+         *     with graph optimizations disabled. Keyed like the compile cache, including the initializers,
+         *     plus the optimization level and the CPU.
+         * Only used when no execution provider is selected, and not for models found in the compile cache.
+         * A session whose optimized model cannot be saved is created without the cache.
+         */
+        void SetOptimizedModelCacheDirectory(const std::string& directory);
+        const std::string& GetOptimizedModelCacheDirectory() const;
+        GraphOptimizationLevel GetSessionGraphOptimizationLevel() const;
+        /** Identifies the selected execution providers. None if a delegate selects them at creation. */
+        std::optional<std::string> GetExecutionProviderKey() const;
+        /** Identifies the config entries and dimension overrides, which change the optimized graph. */
+        const std::string& GetConfigurationKey() const;
+        /** The bytes copied to repack strided initializers. */
+        uint64_t GetRepackedBytes() const;
         ModelCompilationOptions CreateModelCompilationOptions() const;
     private:
+        ScratchArena& GetScratchArena();
         EpSelectionPolicyDelegate _delegate { nullptr };
+        std::vector<Value> _initializers;
+        /** Extended by every initializer added. */
+        std::string _initializersKey;
+        std::string _compileCacheDirectory;
+        std::string _optimizedModelCacheDirectory;
+        GraphOptimizationLevel _graphOptimizationLevel{ ORT_ENABLE_ALL };
+        /** Extended by every call that selects execution providers. */
+        std::string _executionProviderKey;
+        std::string _configurationKey;
+        /** Created with the first initializer. Shared with the clones. */
+        std::shared_ptr<ScratchArena> _scratchArena;
     };
 
     class TypeInfo : public OrtTypeWrapper<OrtTypeInfo, TypeInfo>
@@ -188,7 +319,9 @@ namespace Ortpy
     {
         std::vector<int64_t> shape;
         std::vector<std::string> dimensions;
+        /** The dtype of the arrays. A raw view for the types numpy lacks, see Value::IsRawViewType. */
         nanobind::dlpack::dtype dtype;
+        ONNXTensorElementDataType type{ ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED };
 
         TensorInfo() = default;
         TensorInfo(const TypeInfo& typeInfo);
@@ -207,21 +340,400 @@ namespace Ortpy
         std::string GetRunTag() const;
         void SetTerminate();
         void UnsetTerminate();
+        void AddConfigEntry(const std::string& key, const std::string& value);
+    };
+
+    class PrepackedWeightsContainer : public OrtTypeWrapper<OrtPrepackedWeightsContainer, PrepackedWeightsContainer>
+    {
+    public:
+        static void ReleaseOrtType(OrtPrepackedWeightsContainer* ptr);
+        PrepackedWeightsContainer();
+    };
+
+    /**
+     * Reusable buffers for repacking strided inputs. Shared by the concurrent runs of a session.
+     * Always held by a shared pointer, as the buffers keep their arena alive.
+     */
+    class ScratchArena : public std::enable_shared_from_this<ScratchArena>
+    {
+    public:
+        /** Uninitialized memory. The acquirer overwrites it. */
+        struct Storage
+        {
+            std::unique_ptr<uint8_t[]> data;
+            size_t capacity{ 0 };
+        };
+        /** Returns the storage to the arena when destroyed. */
+        class Buffer
+        {
+        public:
+            Buffer() = default;
+            Buffer(std::shared_ptr<ScratchArena> arena, Storage&& storage);
+            ~Buffer();
+            Buffer(const Buffer&) = delete;
+            Buffer& operator=(const Buffer&) = delete;
+            Buffer(Buffer&& other) noexcept;
+            Buffer& operator=(Buffer&& other) noexcept;
+            /** Null for an empty buffer. */
+            uint8_t* GetData();
+        private:
+            std::shared_ptr<ScratchArena> _arena;
+            Storage _storage;
+        };
+        static constexpr size_t MaxFreeBuffers = 16;
+        /** Counts the size towards the repacked bytes. */
+        Buffer Acquire(size_t size);
+        /** Counts the size towards the padded bytes. */
+        Buffer AcquirePadding(size_t size);
+        uint64_t GetRepackedBytes() const;
+        uint64_t GetPaddedBytes() const;
+    private:
+        Buffer Take(size_t size);
+        void Release(Storage&& storage);
+        std::mutex _mutex;
+        std::vector<Storage> _free;
+        std::atomic<uint64_t> _repackedBytes{ 0 };
+        std::atomic<uint64_t> _paddedBytes{ 0 };
     };
 
+    /** Opt in counters of the run hot path. Sharded by thread, so concurrent runs do not contend. */
+    class RunMetrics
+    {
+    public:
+        enum Counter : size_t
+        {
+            Calls,
+            InputNs,
+            RunNs,
+            OutputNs,
+            BytesIn,
+            BytesOut,
+            NumCounters
+        };
+        static constexpr size_t NumShards = 16;
+        static const char* GetCounterName(Counter counter);
+
+        /** Times the phases of one run. Does nothing when the metrics are disabled. */
+        class Stopwatch
+        {
+        public:
+            Stopwatch(RunMetrics& metrics);
+            bool IsEnabled() const;
+            /** Adds the time since the last lap to the counter. */
+            void Lap(Counter counter);
+            void Add(Counter counter, uint64_t value);
+        private:
+            RunMetrics* _metrics{ nullptr };
+            std::chrono::steady_clock::time_point _last{};
+        };
+
+        void SetEnabled(bool enabled);
+        bool IsEnabled() const;
+        void Add(Counter counter, uint64_t value);
+        std::array<uint64_t, NumCounters> Snapshot() const;
+        void Reset();
+    private:
+        static size_t GetShardIndex();
+        struct alignas(64) Shard
+        {
+            std::array<std::atomic<uint64_t>, NumCounters> values{};
+        };
+        std::atomic<bool> _enabled{ false };
+        std::array<Shard, NumShards> _shards{};
+    };
+
+    /** A read only memory mapping of a whole file. The pages are shared with other processes mapping it. */
+    class MappedFile
+    {
+    public:
+        MappedFile(const std::string& path);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&&) = delete;
+        MappedFile& operator=(MappedFile&&) = delete;
+        const void* GetData() const;
+        size_t GetSize() const;
+    private:
+        void* _data{ nullptr };
+        size_t _size{ 0 };
+    };
+
+    class IoBinding;
+    class PreparedRun;
+
     class Session : public OrtTypeWrapper<OrtSession, Session>
     {
     public:
         static void ReleaseOrtType(OrtSession* ptr);
         Session(const std::string& modelPath, const SessionOptions& options);
-        Session(const nanobind::bytes& modelBytes, const SessionOptions& options);
+        /** Maps the model file instead of reading it when memoryMap is set. */
+        Session(const std::string& modelPath, const SessionOptions& options, bool memoryMap);
+        /** modelBytes can be any buffer protocol object. A read only buffer is used in place for ORT format models. */
+        Session(const nanobind::object& modelBytes, const SessionOptions& options);
+        /** Sessions sharing a container do not resolve the compile cache. Their pool does it once for all. */
+        Session(const std::string& modelPath, const SessionOptions& options,
+            const PrepackedWeightsContainer& container);
+        Session(const nanobind::object& modelBytes, const SessionOptions& options,
+            const PrepackedWeightsContainer& container);
+        Session(const std::shared_ptr<const MappedFile>& model, const SessionOptions& options,
+            const PrepackedWeightsContainer& container);
+        ~Session();
+        /**
+         * Creates the session on a native thread without the GIL.
+         * Returns a concurrent.futures.Future resolved with the session.
+         */
+        static nanobind::object CreateAsync(const std::string& modelPath, const SessionOptions& options, bool memoryMap);
 
         std::unordered_map<std::string, TensorInfo> GetInputInfo() const;
         std::unordered_map<std::string, TensorInfo> GetOutputInfo() const;
-        std::unordered_map<std::string, NpArray> Run(
-            const std::unordered_map<std::string, NpArray>& inputs,
+        const std::vector<std::string>& GetInputNames() const;
+        const std::vector<std::string>& GetOutputNames() const;
+        ScratchArena& GetScratchArena() const;
+        uint64_t GetRepackedBytes() const;
+        RunMetrics& GetRunMetrics() const;
+        void EnableMetrics(bool enabled);
+        void ResetMetrics();
+        /** Counters since creation or the last reset. Times are in nanoseconds. */
+        std::unordered_map<std::string, uint64_t> GetMetrics() const;
+        /** The counters in the Prometheus text exposition format, labeled with the given session name. */
+        std::string GetMetricsText(const std::string& sessionName) const;
+        /** Stops profiling and returns the path of the written profile. */
+        std::string EndProfiling();
+        uint64_t GetProfilingStartTimeNs() const;
+        nanobind::dict Run(
+            const std::unordered_map<std::string, SessionInput>& inputs,
+            const std::optional<std::vector<std::string>>& outputNames,
+            const std::optional<std::reference_wrapper<RunOptions>>& runOptions,
+            ArrayFramework outputFramework) const;
+        /** Converts the python inputs itself, so the input metrics include the conversion. */
+        nanobind::dict Run(
+            const nanobind::dict& inputs,
             const std::optional<std::vector<std::string>>& outputNames,
+            const std::optional<std::reference_wrapper<RunOptions>>& runOptions,
+            ArrayFramework outputFramework) const;
+        /** Returns a concurrent.futures.Future resolved with the outputs of Run. */
+        nanobind::object RunAsync(
+            const std::unordered_map<std::string, InputArray>& inputs,
+            const std::optional<std::vector<std::string>>& outputNames,
+            const std::optional<std::reference_wrapper<RunOptions>>& runOptions,
+            ArrayFramework outputFramework) const;
+        void RunWithBinding(
+            const IoBinding& binding,
             const std::optional<std::reference_wrapper<RunOptions>>& runOptions) const;
+        PreparedRun Prepare(
+            const std::vector<std::string>& inputNames,
+            const std::optional<std::vector<std::string>>& outputNames,
+            const std::optional<std::reference_wrapper<RunOptions>>& runOptions,
+            ArrayFramework outputFramework) const;
+        /** The expected type of an input given as a raw view array, or undefined. */
+        ONNXTensorElementDataType GetRawViewInputType(const std::string& name) const;
+    private:
+        friend class PreparedRun;
+        nanobind::dict Run(
+            const std::unordered_map<std::string, SessionInput>& inputs,
+            const std::optional<std::vector<std::string>>& outputNames,
+            const std::optional<std::reference_wrapper<RunOptions>>& runOptions,
+            ArrayFramework outputFramework,
+            RunMetrics::Stopwatch& stopwatch) const;
+        static OrtSession* CreateFromPath(const std::string& modelPath, const SessionOptions& options,
+            const PrepackedWeightsContainer* container);
+        static OrtSession* CreateFromBuffer(const void* data, size_t size, bool inPlace,
+            const SessionOptions& options, const PrepackedWeightsContainer* container);
+        void CreateFromMappedFile(const std::shared_ptr<const MappedFile>& model, const SessionOptions& options,
+            const PrepackedWeightsContainer* container);
+        void CreateFromPyBuffer(const nanobind::object& modelBytes, const SessionOptions& options,
+            const PrepackedWeightsContainer* container);
+        /** Loads the cached optimized model, or creates the session from the source and saves it on a miss. */
+        void CreateWithOptimizedModelCache(const std::string& cachePath, const SessionOptions& options,
+            bool memoryMap, const std::function<void(const SessionOptions&)>& createFromSource);
+        void LoadMetadata();
+        /**
+         * The mapped file or python buffer ort uses in place for ORT format models.
+         * It must outlive the session, which is released first in the destructor.
+         */
+        std::shared_ptr<const void> _modelOwner;
+        /** Initializers added through the session options, which may be destroyed before the session. */
+        std::vector<Value> _initializers;
+        /** The model signature never changes after creation. Query it only once. */
+        std::vector<std::string> _inputNames;
+        std::vector<const char*> _inputNamesView;
+        std::vector<TensorInfo> _inputInfos;
+        /** The inputs of raw view types by name. Usually empty, which keeps the lookup off the hot path. */
+        std::unordered_map<std::string, ONNXTensorElementDataType> _rawViewInputTypes;
+        std::vector<std::string> _outputNames;
+        std::vector<const char*> _outputNamesView;
+        std::vector<TensorInfo> _outputInfos;
+        std::shared_ptr<ScratchArena> _scratchArena{ std::make_shared<ScratchArena>() };
+        mutable RunMetrics _metrics;
+    };
+
+    /** Sessions of the same model sharing their prepacked weights. */
+    class SessionPool
+    {
+    public:
+        /** A checked out session. It goes back to the pool on release, or when destroyed. */
+        class Lease
+        {
+        public:
+            Lease(SessionPool& pool, size_t index);
+            ~Lease();
+            Lease(const Lease&) = delete;
+            Lease& operator=(const Lease&) = delete;
+            Lease(Lease&& other) noexcept;
+            Lease& operator=(Lease&& other) = delete;
+            Session& GetSession() const;
+            void Release();
+        private:
+            SessionPool* _pool{ nullptr };
+            size_t _index{ 0 };
+        };
+
+        static constexpr size_t MaxSize = 64;
+        SessionPool(const std::string& modelPath, const SessionOptions& options, size_t size);
+        /** All the sessions share one mapping of the model file when memoryMap is set. */
+        SessionPool(const std::string& modelPath, const SessionOptions& options, size_t size, bool memoryMap);
+        SessionPool(const nanobind::object& modelBytes, const SessionOptions& options, size_t size);
+        size_t GetSize() const;
+        std::unordered_map<std::string, TensorInfo> GetInputInfo() const;
+        std::unordered_map<std::string, TensorInfo> GetOutputInfo() const;
+        nanobind::dict Run(
+            const nanobind::dict& inputs,
+            const std::optional<std::vector<std::string>>& outputNames,
+            const std::optional<std::reference_wrapper<RunOptions>>& runOptions,
+            ArrayFramework outputFramework);
+        /** Lock free. Waits without the GIL while every session is checked out. */
+        Lease Checkout();
+    private:
+        static void CheckSize(size_t size);
+        void Return(size_t index);
+        /** Must outlive the sessions. */
+        PrepackedWeightsContainer _container{};
+        std::vector<std::unique_ptr<Session>> _sessions;
+        /** One bit per idle session. */
+        std::atomic<uint64_t> _idle{ 0 };
+    };
+
+    /**
+     * Coalesces concurrent runs into one batched run of the session.
+     * The requests are concatenated along the batch axis and the outputs are split back.
+     */
+    class BatchingSession
+    {
+    public:
+        BatchingSession(const Session& session, size_t maxBatchSize, double maxWaitMs, size_t batchAxis);
+        ~BatchingSession();
+        BatchingSession(const BatchingSession&) = delete;
+        BatchingSession& operator=(const BatchingSession&) = delete;
+        nanobind::dict Run(const std::unordered_map<std::string, InputArray>& inputs, ArrayFramework outputFramework);
+    private:
+        struct BatchOutputs;
+        struct Request;
+        void Worker();
+        std::vector<Request*> TakeBatch();
+        void RunBatch(const std::vector<Request*>& batch);
+        /** Kept alive by the python object. */
+        const Session* _session{ nullptr };
+        size_t _maxBatchSize{ 0 };
+        std::chrono::microseconds _maxWait{ 0 };
+        size_t _batchAxis{ 0 };
+        /** Ordered as the session outputs. Whether the output shares the inputs' symbolic batch dimension. */
+        std::vector<bool> _isOutputBatched;
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        std::deque<Request*> _queue;
+        size_t _queuedBatchSize{ 0 };
+        bool _stopping{ false };
+        /** Must be the last member so that everything above is ready when it starts. */
+        std::thread _worker;
+    };
+
+    /**
+     * Runs a model with symbolic dimensions on sessions specialized to fixed sizes of them.
+     * The sizes are rounded up to a power of two. The inputs are padded with zeros to the bucket
+     *     and the outputs sharing a bucketed dimension are sliced back as views.
+     * The most recently used sessions are kept. They share their prepacked weights.
+     */
+    class ShapeBucketedSession
+    {
+    public:
+        ShapeBucketedSession(const std::string& modelPath, const SessionOptions& options,
+            const std::vector<std::string>& dimensionNames, size_t maxSessions, int64_t minBucketSize,
+            bool memoryMap);
+        /** The smallest power of two not below size or minBucketSize. */
+        static int64_t GetBucketSize(int64_t size, int64_t minBucketSize);
+        std::unordered_map<std::string, TensorInfo> GetInputInfo() const;
+        std::unordered_map<std::string, TensorInfo> GetOutputInfo() const;
+        size_t GetNumSessions();
+        /** The bytes of zeros and copies added to pad the inputs to their buckets. */
+        uint64_t GetPaddedBytes() const;
+        /** String inputs are not padded. Their bucketed axes must already have the bucket size. */
+        nanobind::dict Run(
+            const std::unordered_map<std::string, SessionInput>& inputs,
+            const std::optional<std::vector<std::string>>& outputNames,
+            const std::optional<std::reference_wrapper<RunOptions>>& runOptions,
+            ArrayFramework outputFramework);
+    private:
+        /** An axis of a tensor and the index of its bucketed dimension. */
+        struct BucketedAxis
+        {
+            size_t axis;
+            size_t dimension;
+        };
+        using BucketedAxes = std::unordered_map<std::string, std::vector<BucketedAxis>>;
+        static BucketedAxes FindBucketedAxes(const std::unordered_map<std::string, TensorInfo>& infos,
+            const std::vector<std::string>& dimensionNames);
+        std::shared_ptr<Session> GetSession(const std::vector<int64_t>& bucketSizes);
+        std::string _modelPath;
+        /** Kept alive by the python object. */
+        const SessionOptions* _options{ nullptr };
+        std::vector<std::string> _dimensionNames;
+        size_t _maxSessions{ 0 };
+        int64_t _minBucketSize{ 1 };
+        std::shared_ptr<const MappedFile> _mappedModel;
+        std::unordered_map<std::string, TensorInfo> _inputInfos;
+        std::unordered_map<std::string, TensorInfo> _outputInfos;
+        BucketedAxes _inputAxes;
+        BucketedAxes _outputAxes;
+        /** Shared by the sessions of every bucket. */
+        std::shared_ptr<ScratchArena> _paddingArena{ std::make_shared<ScratchArena>() };
+        /** Must outlive the sessions. */
+        PrepackedWeightsContainer _container{};
+        std::mutex _mutex;
+        /** Keyed by the bucket sizes. The most recently used first. */
+        std::list<std::pair<std::vector<int64_t>, std::shared_ptr<Session>>> _sessions;
+    };
+
+    /** A run with a fixed signature. Everything but the input arrays is resolved up front. */
+    class PreparedRun
+    {
+    public:
+        PreparedRun(
+            const Session& session,
+            const std::vector<std::string>& inputNames,
+            const std::optional<std::vector<std::string>>& outputNames,
+            const std::optional<std::reference_wrapper<RunOptions>>& runOptions,
+            ArrayFramework outputFramework);
+        /** A copy's views would point into the names of the original. */
+        PreparedRun(const PreparedRun&) = delete;
+        PreparedRun& operator=(const PreparedRun&) = delete;
+        /** Moving a vector hands over its buffer, so the names stay in place and the views stay valid. */
+        PreparedRun(PreparedRun&&) noexcept = default;
+        PreparedRun& operator=(PreparedRun&&) noexcept = default;
+        nanobind::tuple operator()(const nanobind::args& inputs) const;
+        const std::vector<std::string>& GetInputNames() const;
+        const std::vector<std::string>& GetOutputNames() const;
+    private:
+        /** Both are kept alive by the python object. */
+        const Session* _session{ nullptr };
+        const RunOptions* _runOptions{ nullptr };
+        ArrayFramework _outputFramework{ ArrayFramework::Numpy };
+        std::vector<std::string> _inputNames;
+        /** Point into the names of this object. */
+        std::vector<const char*> _inputNamesView;
+        std::vector<TensorInfo> _inputInfos;
+        std::vector<std::string> _outputNames;
+        std::vector<const char*> _outputNamesView;
     };
 
     class Value
@@ -231,18 +743,46 @@ namespace Ortpy
         static nanobind::dlpack::dtype OrtTypeToNpType(ONNXTensorElementDataType type);
         static std::string NpTypeToName(const nanobind::dlpack::dtype& npType);
         static size_t GetSizeOfOrtType(ONNXTensorElementDataType type);
+        static std::string OrtTypeToName(ONNXTensorElementDataType type);
+        /**
+         * Types numpy lacks. Their arrays are raw views: uint16 for bfloat16 and uint8 for the float8 types.
+         * int4 and uint4 are unpacked to int8 and uint8, a byte per element.
+         */
+        static bool IsRawViewType(ONNXTensorElementDataType type);
+        /** Two elements per byte. Tensors of these types take (count + 1) / 2 bytes. */
+        static bool IsPackedType(ONNXTensorElementDataType type);
 
         Value(OrtValue* ptr);
-        Value(const NpArray& NpArray);
+        /**
+         * A raw view array is reinterpreted as the expected type of the input, if given. See TensorView.
+         * A strided array is repacked into a buffer from the arena, if given, or into a tensor of its own.
+         */
+        Value(const InputArray& array,
+            ONNXTensorElementDataType expectedType = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED,
+            ScratchArena* scratchArena = nullptr);
         Value(const std::vector<int64_t>& shape, ONNXTensorElementDataType type);
 
         operator NpArray() const;
+        /**
+         * A view of the data in the given framework, made on each call. It keeps the value alive.
+         * Sequences become lists, maps dicts, missing optional values None and strings a StringTensor.
+         */
+        nanobind::object ToPython(ArrayFramework framework) const;
         operator OrtValue*() const;
+        /** False for a missing optional value. */
+        bool HasValue() const;
+        ONNXType GetOnnxType() const;
+        /** The number of elements of a sequence or map. */
+        size_t GetElementCount() const;
+        /** An element of a sequence, or the keys (0) and values (1) of a map. */
+        Value GetElement(size_t index) const;
         ONNXTensorElementDataType GetType() const;
         std::vector<int64_t> GetShape() const;
         size_t GetSize() const;
         void* GetData() const;
     private:
+        template <typename... Framework>
+        nanobind::ndarray<Framework..., nanobind::device::cpu, nanobind::c_contig> MakeArray() const;
         struct State
         {
             /** 
@@ -255,6 +795,8 @@ namespace Ortpy
              * A view / reference to the data if not.
              */
             std::optional<NpArray> npArray { std::nullopt };
+            /** Holds the data of a repacked array. Released after the ort value. */
+            ScratchArena::Buffer repacked;
             State() = default;
             State(const State&) = delete;
             State& operator=(const State&) = delete;
@@ -265,10 +807,132 @@ namespace Ortpy
         std::shared_ptr<State> _state{ std::make_shared<State>() };
     };
 
+    /**
+     * A tensor of utf-8 strings, owned by ort.
+     * Filled from numpy arrays or from a flat buffer with offsets, without a python object per element.
+     */
+    class StringTensor
+    {
+    public:
+        StringTensor(const Value& value);
+        StringTensor(const std::vector<int64_t>& shape);
+        /**
+         * numpy arrays of bytes ('S'), str ('U'), StringDType ('T') or objects holding str or bytes.
+         * Anything else is converted by numpy.asarray first.
+         */
+        static StringTensor FromArray(const nanobind::object& strings);
+        /** Element i is data[offsets[i]:offsets[i + 1]]. offsets has one more element than the tensor. */
+        static StringTensor FromBuffer(const nanobind::object& data, const InputArray& offsets,
+            const std::vector<int64_t>& shape);
+        std::vector<int64_t> GetShape() const;
+        size_t GetCount() const;
+        /** The content as one bytes object, and the int64 offsets of the elements followed by the end. */
+        nanobind::tuple GetContent() const;
+        /**
+         * A numpy object array of str, shaped as the tensor.
+         * Invalid UTF-8 bytes become lone surrogates, which encode back to the same bytes with surrogateescape.
+         */
+        nanobind::object ToNumpy() const;
+        const Value& GetValue() const;
+    private:
+        /** Resizes the element and returns its buffer, which ort null terminates. */
+        char* GetElementBuffer(size_t index, size_t length);
+        Value _value;
+    };
+
+    /**
+     * A tensor viewing the data of an array for the duration of a run.
+     * Unlike Value, it does not keep the array alive. The array must outlive it.
+     * A strided array is repacked into a buffer from the arena instead.
+     * It may also adopt a raw tensor created by the binding code, without any python object.
+     */
+    class TensorView : public OrtTypeWrapper<OrtValue, TensorView>
+    {
+    public:
+        static void ReleaseOrtType(OrtValue* ptr);
+        using OrtTypeWrapper::OrtTypeWrapper;
+        /** A raw view array is reinterpreted as the expected type of the input, if given. */
+        TensorView(const InputArray& array, ScratchArena& scratchArena,
+            ONNXTensorElementDataType expectedType = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED);
+    private:
+        ScratchArena::Buffer _repacked;
+    };
+
+    class IoBinding : public OrtTypeWrapper<OrtIoBinding, IoBinding>
+    {
+    public:
+        static void ReleaseOrtType(OrtIoBinding* ptr);
+        IoBinding(const Session& session);
+        void BindInput(const std::string& name, const InputArray& array);
+        void BindInput(const std::string& name, const StringTensor& strings);
+        void BindOutput(const std::string& name, const InputArray& array);
+        void BindOutputToCpu(const std::string& name);
+        void ClearBoundInputs();
+        void ClearBoundOutputs();
+        nanobind::dict GetOutputs(ArrayFramework outputFramework) const;
+    private:
+        /** Copied from the session, which may be destroyed before the binding. */
+        std::unordered_map<std::string, ONNXTensorElementDataType> _rawViewInputTypes;
+        std::shared_ptr<ScratchArena> _scratchArena;
+        /** The bound arrays must outlive the binding, or until they are unbound. */
+        std::unordered_map<std::string, Value> _inputs;
+        std::unordered_map<std::string, Value> _outputs;
+    };
+
     class MemoryInfo : public OrtTypeWrapper<OrtMemoryInfo, MemoryInfo>
     {
     public:
         static void ReleaseOrtType(OrtMemoryInfo* ptr);
         MemoryInfo();
     };
+
+    struct BenchmarkResult
+    {
+        size_t numThreads{ 0 };
+        int64_t batchSize{ 0 };
+        /** Timed runs over all threads. */
+        size_t numRuns{ 0 };
+        double meanMs{ 0 };
+        double p50Ms{ 0 };
+        double p90Ms{ 0 };
+        double p99Ms{ 0 };
+        double runsPerSecond{ 0 };
+        double samplesPerSecond{ 0 };
+        /**
+         * Resident memory gained from the start to the end of this measurement, e.g. by arena growth.
+         * Memory freed before the end is not seen. Negative if the process released memory meanwhile.
+         */
+        int64_t rssIncreaseBytes{ 0 };
+    };
+
+    /** Per node and per op type kernel times aggregated from a profile, sorted by total time. */
+    struct ProfileSummary
+    {
+        /** model_run events */
+        size_t numRuns{ 0 };
+        int64_t runTotalUs{ 0 };
+        std::vector<std::string> nodeNames;
+        std::vector<std::string> nodeOpTypes;
+        std::vector<std::string> nodeProviders;
+        std::vector<int64_t> nodeTotalUs;
+        std::vector<int64_t> nodeCounts;
+        std::vector<std::string> opTypes;
+        std::vector<int64_t> opTotalUs;
+        std::vector<int64_t> opCounts;
+
+        static ProfileSummary Parse(const std::string& profilePath);
+    };
+
+    /**
+     * Runs the session with generated inputs on native threads, for every thread count and batch size.
+     * A dynamic first dimension takes the batch size. Other dynamic dimensions are looked up by name
+     *     in dimensionOverrides, which also takes precedence for the first one, and default to 1.
+     */
+    std::vector<BenchmarkResult> Benchmark(
+        const Session& session,
+        const std::unordered_map<std::string, int64_t>& dimensionOverrides,
+        const std::vector<size_t>& threadCounts,
+        const std::vector<int64_t>& batchSizes,
+        size_t warmupRuns,
+        size_t timedRuns);
 }